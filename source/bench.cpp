@@ -0,0 +1,598 @@
+//
+// Copyright(C) 2007-2017 Stephen McGranahan
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/
+//
+// Purpose: Microbenchmarks for the drawers, lighting and visplanes
+// Authors: Stephen McGranahan
+//
+// Usage: cardboard_bench [-time <ms>] [-filter <name>]
+//
+// Every benchmark is run in batches that take at least a fifth of -time (200 ms by default),
+// and the fastest of five batches is reported. The results are written to stdout as JSON.
+//
+
+#include <SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "render.h"
+#include "mapdata.h"
+#include "bsp.h"
+#include "transform.h"
+#include "visplane.h"
+
+vidDriver *screen;
+
+// MaxW: Win32 doesn't need SDL main.
+#if defined(_MSC_VER) || defined(__CYGWIN__) || defined(__MINGW32__)
+#undef main
+#endif
+
+#define BENCH_WIDTH  1920
+#define BENCH_HEIGHT 1080
+
+// Same as the column chunks in render.cpp.
+#define BENCH_CHUNK_WIDTH 16
+
+typedef void (*benchfunc_t)(void *data, int iterations);
+
+static double mintime = 200.0;
+static const char *filter = NULL;
+static int benchcount = 0;
+
+// Written to so the compiler can't throw away the lighting results.
+static volatile Uint32 sink;
+
+static light_t benchlight = {128, 256, 256, 256, 0, 0, 90, 0, 0};
+static light_t benchfoglight = {160, 256, 240, 220, 64.0f, 1024.0f, 90, 100, 110};
+
+
+static double timeBench(benchfunc_t func, void *data, int iterations)
+{
+   Uint64 start = SDL_GetPerformanceCounter();
+
+   func(data, iterations);
+
+   return (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+
+// Runs a benchmark and prints its JSON entry. params is the body of a JSON object and items
+// is how many pixels (or calls) one iteration covers.
+static void runBench(const char *name, const char *params, benchfunc_t func, void *data, double items, const char *itemname)
+{
+   double batchtime = mintime / 5.0, best, t;
+   int iterations = 1;
+
+   if(filter && !strstr(name, filter))
+      return;
+
+   // Grow the batch until it takes long enough to time, aiming a little past the mark once
+   // there's a usable measurement.
+   while((t = timeBench(func, data, iterations)) < batchtime && iterations < (1 << 28))
+   {
+      if(t > batchtime / 100.0)
+         iterations = (int)(iterations * batchtime * 1.2 / t) + 1;
+      else
+         iterations *= 10;
+   }
+
+   best = t;
+   for(int i = 0; i < 4; i++)
+   {
+      t = timeBench(func, data, iterations);
+      if(t < best)
+         best = t;
+   }
+
+   best *= 1000000.0 / iterations;
+
+   printf("%s    {\"name\": \"%s\", \"params\": {%s}, \"iterations\": %d, \"ns_per_op\": %.3f, \"%ss_per_op\": %.0f, \"ns_per_%s\": %.4f}",
+          benchcount ? ",\n" : "", name, params, iterations, best, itemname, items, itemname, best / items);
+   fflush(stdout);
+   benchcount++;
+}
+
+
+// -- Drawers --
+struct columnbench_t
+{
+   rendercolumn_t column;
+   int            width;
+};
+
+static void benchColumn(void *data, int iterations)
+{
+   columnbench_t *b = (columnbench_t *)data;
+   rendercolumn_t column = b->column;
+
+   // Walk across the screen so every call writes a different column.
+   for(int i = 0; i < iterations; i++)
+   {
+      column.x = i % b->width;
+      drawColumn(column);
+   }
+}
+
+
+struct chunkbench_t
+{
+   rendercolumn_t columns[BENCH_CHUNK_WIDTH], work[BENCH_CHUNK_WIDTH];
+   chunkfunc_t    func;
+   void           *screen;
+   int            pitch, width, height;
+};
+
+static void benchColumnChunk(void *data, int iterations)
+{
+   chunkbench_t *b = (chunkbench_t *)data;
+   int chunks = b->width / BENCH_CHUNK_WIDTH;
+
+   for(int i = 0; i < iterations; i++)
+   {
+      // drawColumnChunk steps the columns' yfrac, so start from a fresh copy every time.
+      memcpy(b->work, b->columns, sizeof(b->work));
+      b->func(b->work, b->screen, b->pitch, BENCH_CHUNK_WIDTH, 0, b->height, (i % chunks) * BENCH_CHUNK_WIDTH);
+   }
+}
+
+
+struct spanbench_t
+{
+   renderspan_t    span;
+   rslopespan_t    slopespan;
+   spanfunc_t      func;
+   slopespanfunc_t slopefunc;
+   int             height;
+};
+
+static void benchSpan(void *data, int iterations)
+{
+   spanbench_t *b = (spanbench_t *)data;
+   renderspan_t span = b->span;
+
+   for(int i = 0; i < iterations; i++)
+   {
+      span.y = i % b->height;
+      b->func(span);
+   }
+}
+
+static void benchSlopedSpan(void *data, int iterations)
+{
+   spanbench_t *b = (spanbench_t *)data;
+   rslopespan_t slopespan = b->slopespan;
+
+   for(int i = 0; i < iterations; i++)
+   {
+      slopespan.y = i % b->height;
+      b->slopefunc(slopespan);
+   }
+}
+
+
+static void benchDrawers(vidDriver *target)
+{
+   static const int lengths[] = {16, 64, 256, 1024};
+   static const int spanlengths[] = {16, 64, 256, 1024, 1920};
+   static const float steps[] = {0.25f, 1.0f, 4.0f};
+   lightblend_t blend = calcLight(0.002f, 0, benchlight);
+   char params[128];
+
+   for(int l = 0; l < 4; l++)
+   {
+      for(int s = 0; s < 3; s++)
+      {
+         columnbench_t cb;
+         chunkbench_t kb;
+         int chunkpixels = 0;
+
+         sprintf(params, "\"length\": %d, \"step\": %.2f", lengths[l], steps[s]);
+
+         cb.column.x = 0;
+         cb.column.y1 = 0;
+         cb.column.y2 = lengths[l] - 1;
+         cb.column.yfrac = 0;
+         cb.column.ystep = (int)(steps[s] * 65536.0f);
+         cb.column.texx = 7 * 64;
+         cb.column.blend = blend;
+         cb.column.tex = texture->getBuffer();
+         cb.column.screen = target->getBuffer();
+         cb.column.pitch = target->getPitch() / 4;
+         cb.width = target->getWidth();
+
+         runBench("drawColumn", params, benchColumn, &cb, lengths[l], "pixel");
+
+         // Staggered column ends, like a wall seen at an angle.
+         for(int i = 0; i < BENCH_CHUNK_WIDTH; i++)
+         {
+            kb.columns[i] = cb.column;
+            kb.columns[i].x = i;
+            kb.columns[i].y1 = i;
+            kb.columns[i].y2 = lengths[l] - 1 - i;
+            kb.columns[i].tex = (Uint32 *)texture->getBuffer() + (i & 63) * 64;
+
+            if(kb.columns[i].y2 >= kb.columns[i].y1)
+               chunkpixels += kb.columns[i].y2 - kb.columns[i].y1 + 1;
+         }
+         kb.screen = target->getBuffer();
+         kb.pitch = target->getPitch() / 4;
+         kb.width = target->getWidth();
+         kb.height = lengths[l];
+
+         // Once for every SIMD level the CPU has.
+         for(int level = SIMD_NONE; level <= getMaxSIMDLevel(); level++)
+         {
+            char chunkparams[160];
+
+            setSIMDLevel(level);
+            kb.func = getChunkDrawer(0);
+            sprintf(chunkparams, "%s, \"simd\": \"%s\"", params, getSIMDLevelName(level));
+            runBench("drawColumnChunk", chunkparams, benchColumnChunk, &kb, chunkpixels, "pixel");
+         }
+         setSIMDLevel(getMaxSIMDLevel());
+      }
+   }
+
+   for(int l = 0; l < 5; l++)
+   {
+      for(int s = 0; s < 3; s++)
+      {
+         spanbench_t sb;
+         slopelightblend_t sblend = calcSlopeLight(0.0f, 160.0f, benchlight);
+
+         sprintf(params, "\"length\": %d, \"step\": %.2f", spanlengths[l], steps[s]);
+
+         sb.height = target->getHeight();
+
+         sb.span.x1 = 0;
+         sb.span.x2 = spanlengths[l] - 1;
+         sb.span.y = 0;
+         sb.span.xfrac = 0;
+         sb.span.yfrac = 0;
+         sb.span.xstep = (int)(steps[s] * 65536.0f);
+         sb.span.ystep = (int)(steps[s] * 0.5f * 65536.0f);
+         sb.span.blend = blend;
+         sb.span.tex = texture->getBuffer();
+         sb.span.screen = target->getBuffer();
+         sb.span.pitch = target->getPitch() / 4;
+
+         for(int level = SIMD_NONE; level <= getMaxSIMDLevel(); level++)
+         {
+            char spanparams[160];
+
+            setSIMDLevel(level);
+            sb.func = getSpanDrawer(0);
+            sprintf(spanparams, "%s, \"simd\": \"%s\"", params, getSIMDLevelName(level));
+            runBench("drawSpan", spanparams, benchSpan, &sb, spanlengths[l], "pixel");
+         }
+         setSIMDLevel(getMaxSIMDLevel());
+
+         // A plane receding from the camera, u and v are divided by d per pixel.
+         sb.slopespan.x1 = 0;
+         sb.slopespan.x2 = spanlengths[l] - 1;
+         sb.slopespan.y = 0;
+         sb.slopespan.iufrac = 0.0f;
+         sb.slopespan.ivfrac = 0.0f;
+         sb.slopespan.idfrac = 1.0f;
+         sb.slopespan.iustep = steps[s];
+         sb.slopespan.ivstep = steps[s] * 0.5f;
+         sb.slopespan.idstep = 1.0f / 4096.0f;
+         sb.slopespan.rfrac = (int)(sblend.rf * 65536.0f);
+         sb.slopespan.gfrac = (int)(sblend.gf * 65536.0f);
+         sb.slopespan.bfrac = (int)(sblend.bf * 65536.0f);
+         sb.slopespan.rstep = sb.slopespan.gstep = sb.slopespan.bstep = -16;
+         sb.slopespan.blend = sblend;
+         sb.slopespan.src = texture->getBuffer();
+         sb.slopespan.dest = target->getBuffer();
+         sb.slopespan.pitch = target->getPitch() / 4;
+
+         for(int level = SIMD_NONE; level <= getMaxSIMDLevel(); level++)
+         {
+            char spanparams[160];
+
+            setSIMDLevel(level);
+            sb.slopefunc = getSlopedSpanDrawer(0);
+            sprintf(spanparams, "%s, \"simd\": \"%s\"", params, getSIMDLevelName(level));
+            runBench("drawSlopedSpan", spanparams, benchSlopedSpan, &sb, spanlengths[l], "pixel");
+         }
+         setSIMDLevel(getMaxSIMDLevel());
+      }
+   }
+}
+
+
+// -- Lighting --
+#define LIGHT_SAMPLES 1024
+
+struct lightbench_t
+{
+   light_t  light;
+   Uint32   lightid;
+   float    distances[LIGHT_SAMPLES];
+};
+
+static void benchCalcLight(void *data, int iterations)
+{
+   lightbench_t *b = (lightbench_t *)data;
+   Uint32 acc = 0;
+
+   for(int i = 0; i < iterations; i++)
+   {
+      for(int s = 0; s < LIGHT_SAMPLES; s++)
+      {
+         lightblend_t blend = calcLight(b->distances[s], 0, b->light);
+         acc += blend.l_r + blend.fogadd;
+      }
+   }
+
+   sink = acc;
+}
+
+static void benchLightBlend(void *data, int iterations)
+{
+   lightbench_t *b = (lightbench_t *)data;
+   Uint32 acc = 0;
+
+   for(int i = 0; i < iterations; i++)
+   {
+      for(int s = 0; s < LIGHT_SAMPLES; s++)
+      {
+         const lightblend_t &blend = getLightBlend(b->lightid, b->distances[s]);
+         acc += blend.l_r + blend.fogadd;
+      }
+   }
+
+   sink = acc;
+}
+
+static void benchCalcSlopeLight(void *data, int iterations)
+{
+   lightbench_t *b = (lightbench_t *)data;
+   Uint32 acc = 0;
+
+   for(int i = 0; i < iterations; i++)
+   {
+      for(int s = 0; s < LIGHT_SAMPLES; s++)
+      {
+         slopelightblend_t blend = calcSlopeLight(0.0f, b->distances[s], b->light);
+         acc += (Uint32)blend.rf + blend.fogadd;
+      }
+   }
+
+   sink = acc;
+}
+
+
+static void benchLighting(void)
+{
+   lightbench_t lb;
+
+   for(int fog = 0; fog < 2; fog++)
+   {
+      lb.light = fog ? benchfoglight : benchlight;
+      lb.lightid = internLight(lb.light);
+
+      // calcLight takes 1 / distance, the range covers walls from right up close to far away.
+      for(int s = 0; s < LIGHT_SAMPLES; s++)
+         lb.distances[s] = 1.0f / (1.0f + s * 2.0f);
+
+      runBench("calcLight", fog ? "\"fog\": true" : "\"fog\": false", benchCalcLight, &lb, LIGHT_SAMPLES, "call");
+      runBench("getLightBlend", fog ? "\"fog\": true" : "\"fog\": false", benchLightBlend, &lb, LIGHT_SAMPLES, "call");
+
+      // calcSlopeLight takes the colormap index.
+      for(int s = 0; s < LIGHT_SAMPLES; s++)
+         lb.distances[s] = (float)(s % 512) - 256.0f;
+
+      runBench("calcSlopeLight", fog ? "\"fog\": true" : "\"fog\": false", benchCalcSlopeLight, &lb, LIGHT_SAMPLES, "call");
+   }
+}
+
+
+// -- Visplanes --
+// One frame's worth of floor and ceiling marks.
+#define PLANE_LOOKUPS 1024
+
+struct planelookup_t
+{
+   float z;
+   int   x1, x2;
+};
+
+struct planebench_t
+{
+   planepool_t    pool;
+   Uint32         lightid;
+   planelookup_t  lookups[PLANE_LOOKUPS];
+   int            width;
+};
+
+static void benchFindVisplane(void *data, int iterations)
+{
+   planebench_t *b = (planebench_t *)data;
+
+   for(int i = 0; i < iterations; i++)
+   {
+      unlinkPlanes(b->pool, 0, b->width - 1);
+
+      for(int l = 0; l < PLANE_LOOKUPS; l++)
+      {
+         planelookup_t &pl = b->lookups[l];
+
+         checkVisplane(b->pool, findVisplane(b->pool, pl.z, b->lightid, benchlight, NULL), pl.x1, pl.x2);
+      }
+   }
+}
+
+
+static void benchVisplaneLookups(int width)
+{
+   static const int planecounts[] = {16, 64, 256, 1024};
+   planebench_t *b = new planebench_t();
+   char params[128];
+
+   b->width = width;
+   b->lightid = internLight(benchlight);
+
+   for(int p = 0; p < 4; p++)
+   {
+      // The same pseudo random walls every run. Like the walls of a frame they march across
+      // the screen, each one marking a few columns of one of planecounts[p] heights.
+      Uint32 seed = 12345;
+      int x = 0;
+
+      for(int l = 0; l < PLANE_LOOKUPS; l++)
+      {
+         int w;
+
+         seed = seed * 1103515245 + 12345;
+         b->lookups[l].z = (float)((seed >> 8) % planecounts[p]) * 8.0f - 256.0f;
+
+         seed = seed * 1103515245 + 12345;
+         w = 1 + (seed >> 8) % 3;
+
+         if(x + w > width)
+            x = 0;
+
+         b->lookups[l].x1 = x;
+         b->lookups[l].x2 = x + w - 1;
+         x += w;
+      }
+
+      sprintf(params, "\"planes\": %d, \"lookups\": %d", planecounts[p], PLANE_LOOKUPS);
+      runBench("findVisplane", params, benchFindVisplane, b, PLANE_LOOKUPS, "lookup");
+   }
+
+   delete b;
+}
+
+
+struct renderplanebench_t
+{
+   rendercontext_t   *ctx;
+   visplane_t        *plane;
+};
+
+static void benchRenderVisplane(void *data, int iterations)
+{
+   renderplanebench_t *b = (renderplanebench_t *)data;
+   renderstats_t stats;
+
+   clearStats(stats);
+
+   for(int i = 0; i < iterations; i++)
+   {
+      // Every pass is a new frame, so the flat row caches start out empty like they would.
+      b->ctx->planeframe++;
+      renderVisplane(*b->ctx, b->plane, stats);
+   }
+}
+
+
+static void benchRenderVisplanes(rendercontext_t &ctx)
+{
+   static const int widths[] = {256, BENCH_WIDTH};
+   planepool_t *pool = new planepool_t();
+   const viewport_t &view = ctx.view;
+   char params[128];
+
+   for(int sloped = 0; sloped < 2; sloped++)
+   {
+      for(int f = 0; f < 4; f++)
+      {
+         int w = f & 1;
+         bool fragmented = f >= 2;
+         renderplanebench_t b;
+         int x1 = (view.width - widths[w]) / 2, x2 = x1 + widths[w] - 1;
+         double pixels = 0;
+
+         unlinkPlanes(*pool, 0, view.width - 1);
+
+         // A floor below the horizon with a ragged top edge, so spans start and stop all
+         // over the place. A fragmented one has every other column cut short, so the rows
+         // in between are all one pixel spans.
+         b.ctx = &ctx;
+         b.plane = checkVisplane(*pool, findVisplane(*pool, -48.0f, internLight(benchlight), benchlight, sloped ? sectorlist[0].fslope : NULL), x1, x2);
+
+         for(int x = x1; x <= x2; x++)
+         {
+            if(fragmented)
+               b.plane->top[x] = (Uint16)(view.ycenter + 8 + (x & 1) * (int)((view.height - view.ycenter) / 2));
+            else
+               b.plane->top[x] = (Uint16)(view.ycenter + 8 + ((x / 4) % 48) + ((x / 32) % 5) * 16);
+            b.plane->bot[x] = (Uint16)(view.height - 1 - (x % 3));
+            pixels += b.plane->bot[x] - b.plane->top[x] + 1;
+         }
+
+         sprintf(params, "\"sloped\": %s, \"fragmented\": %s, \"width\": %d",
+                 sloped ? "true" : "false", fragmented ? "true" : "false", widths[w]);
+         runBench("renderVisplane", params, benchRenderVisplane, &b, pixels, "pixel");
+      }
+   }
+
+   delete pool;
+}
+
+
+int main(int argc, char **argv)
+{
+   for(int i = 1; i < argc; i++)
+   {
+      // -time <ms>: the minimum time spent on each benchmark.
+      if(!strcmp(argv[i], "-time") && i + 1 < argc)
+         mintime = atof(argv[++i]);
+      // -filter <name>: only run benchmarks with name in their name.
+      else if(!strcmp(argv[i], "-filter") && i + 1 < argc)
+         filter = argv[++i];
+   }
+
+   if(SDL_Init(SDL_INIT_TIMER) == -1)
+      return -1;
+
+   // A generated texture and an offscreen target, so the benchmarks don't need a display
+   // or any data files.
+   screen = new vidDriver(BENCH_WIDTH, BENCH_HEIGHT, 32);
+   texture = new vidDriver(64, 64, 32);
+   texture->lock();
+   for(int i = 0; i < 64 * 64; i++)
+      ((Uint32 *)texture->getBuffer())[i] = ((i * 2654435761u) >> 8) & 0xffffff;
+
+   hackMapData();
+   buildNodes();
+   initVertexBuffer();
+
+   rendercontext_t *ctx = new rendercontext_t();
+
+   moveCamera(ctx->camera, -192.0f);
+   flyCamera(ctx->camera, -39.0f);
+   initRenderer(*ctx, screen);
+
+   // One frame sets up the view for renderVisplane.
+   renderScene(*ctx);
+
+   screen->lock();
+
+   printf("{\n  \"width\": %d,\n  \"height\": %d,\n  \"min_time_ms\": %.0f,\n  \"benchmarks\": [\n", BENCH_WIDTH, BENCH_HEIGHT, mintime);
+
+   benchDrawers(screen);
+   benchLighting();
+   benchVisplaneLookups(BENCH_WIDTH);
+   benchRenderVisplanes(*ctx);
+
+   printf("\n  ]\n}\n");
+
+   screen->unlock();
+   return 0;
+}
@@ -0,0 +1,357 @@
+//
+// Copyright(C) 2007-2017 Stephen McGranahan
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/
+//
+// Purpose: BSP tree construction and front-to-back traversal
+// Authors: Stephen McGranahan
+//
+
+#include <SDL.h>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "error.h"
+#include "mapdata.h"
+#include "bsp.h"
+#include "vectors.h"
+
+
+Uint32     segcount = 0;
+mapseg_t   *seglist = NULL;
+
+Uint32     nodecount = 0;
+bspnode_t  *nodelist = NULL;
+
+Uint32     splitvertexcount = 0;
+mapvertex_t *splitvertexlist = NULL;
+
+
+// Points closer than this to a partition line are considered to be on it.
+#define PARTITION_EPSILON 0.001f
+
+// Evaluating every seg as a partition candidate is O(n^2) per node, so on large maps only
+// this many evenly spaced candidates are scored.
+#define MAX_CANDIDATES 64
+
+
+int pointOnSide(float x, float y, const bspnode_t *node)
+{
+   return ((x - node->x) * node->dy - (y - node->y) * node->dx) < 0.0f ? 1 : 0;
+}
+
+
+
+// -- Node building --
+// While building, segs reference vertices by index so splitvertexlist can be grown freely.
+// Indices below vertexcount are map vertices, the rest are split vertices.
+struct buildseg_t
+{
+   Uint32      v1, v2;
+   float       offset;
+   mapline_t   *line;
+};
+
+static Uint32     maxsplitvertices = 0;
+static Uint32     maxnodes = 0;
+static Uint32     maxsegs = 0;
+static buildseg_t *outsegs = NULL;
+
+
+static mapvertex_t *getVertex(Uint32 index)
+{
+   return index < vertexcount ? vertexlist + index : splitvertexlist + (index - vertexcount);
+}
+
+
+static Uint32 newVertex(float x, float y)
+{
+   if(splitvertexcount == maxsplitvertices)
+   {
+      maxsplitvertices = maxsplitvertices ? maxsplitvertices * 2 : 256;
+      splitvertexlist = (mapvertex_t *)realloc(splitvertexlist, sizeof(mapvertex_t) * maxsplitvertices);
+      if(!splitvertexlist)
+         fatalError::Throw("buildNodes: out of memory allocating vertices");
+   }
+
+   mapvertex_t *v = splitvertexlist + splitvertexcount;
+   memset(v, 0, sizeof(mapvertex_t));
+   v->x = x;
+   v->y = y;
+
+   return vertexcount + splitvertexcount++;
+}
+
+
+static int newNode(void)
+{
+   if(nodecount == maxnodes)
+   {
+      maxnodes = maxnodes ? maxnodes * 2 : 256;
+      nodelist = (bspnode_t *)realloc(nodelist, sizeof(bspnode_t) * maxnodes);
+      if(!nodelist)
+         fatalError::Throw("buildNodes: out of memory allocating nodes");
+   }
+
+   return nodecount++;
+}
+
+
+static void addOutputSeg(const buildseg_t &seg)
+{
+   if(segcount == maxsegs)
+   {
+      maxsegs = maxsegs ? maxsegs * 2 : 256;
+      outsegs = (buildseg_t *)realloc(outsegs, sizeof(buildseg_t) * maxsegs);
+      if(!outsegs)
+         fatalError::Throw("buildNodes: out of memory allocating segs");
+   }
+
+   outsegs[segcount++] = seg;
+}
+
+
+// Signed distance of the point from the partition, positive on the front (right) side.
+static float partitionDistance(const bspnode_t &part, const mapvertex_t *v)
+{
+   return (v->x - part.x) * part.dy - (v->y - part.y) * part.dx;
+}
+
+
+static bool makePartition(const buildseg_t &seg, bspnode_t &part)
+{
+   mapvertex_t *v1 = getVertex(seg.v1), *v2 = getVertex(seg.v2);
+   vector2f dir(v2->x - v1->x, v2->y - v1->y);
+
+   if(dir.getLength() < PARTITION_EPSILON)
+      return false;
+
+   dir.normalize();
+
+   part.x = v1->x;
+   part.y = v1->y;
+   part.dx = dir.x;
+   part.dy = dir.y;
+   return true;
+}
+
+
+// Classifies a seg against a partition. Returns 0 for front, 1 for back, 2 for a seg that
+// lies on the partition and 3 for a seg that must be split.
+static int classifySeg(const bspnode_t &part, const buildseg_t &seg, float &d1, float &d2)
+{
+   d1 = partitionDistance(part, getVertex(seg.v1));
+   d2 = partitionDistance(part, getVertex(seg.v2));
+
+   if(fabsf(d1) < PARTITION_EPSILON && fabsf(d2) < PARTITION_EPSILON)
+      return 2;
+   if(d1 > -PARTITION_EPSILON && d2 > -PARTITION_EPSILON)
+      return 0;
+   if(d1 < PARTITION_EPSILON && d2 < PARTITION_EPSILON)
+      return 1;
+
+   return 3;
+}
+
+
+// Picks the partition that balances the tree while keeping splits to a minimum.
+static bool choosePartition(buildseg_t *segs, Uint32 count, bspnode_t &best)
+{
+   Uint32 stride = count > MAX_CANDIDATES ? count / MAX_CANDIDATES : 1;
+   int bestscore = -1;
+
+   for(Uint32 i = 0; i < count; i += stride)
+   {
+      bspnode_t part;
+      int front = 0, back = 0, splits = 0, score;
+      float d1, d2;
+
+      if(!makePartition(segs[i], part))
+         continue;
+
+      for(Uint32 j = 0; j < count; j++)
+      {
+         switch(classifySeg(part, segs[j], d1, d2))
+         {
+            case 0: front++;  break;
+            case 1: back++;   break;
+            case 3: splits++; break;
+            default: break;
+         }
+      }
+
+      score = splits * 8 + abs(front - back);
+      if(bestscore == -1 || score < bestscore)
+      {
+         bestscore = score;
+         best = part;
+      }
+   }
+
+   return bestscore != -1;
+}
+
+
+// Sets box to the bounds of the segs. An empty list gets an empty box.
+static void boundSegs(const buildseg_t *segs, Uint32 count, float *box)
+{
+   box[BOXTOP] = box[BOXRIGHT] = -FLT_MAX;
+   box[BOXBOTTOM] = box[BOXLEFT] = FLT_MAX;
+
+   for(Uint32 i = 0; i < count; i++)
+   {
+      const mapvertex_t *v[2] = {getVertex(segs[i].v1), getVertex(segs[i].v2)};
+
+      for(int j = 0; j < 2; j++)
+      {
+         if(v[j]->x < box[BOXLEFT])   box[BOXLEFT] = v[j]->x;
+         if(v[j]->x > box[BOXRIGHT])  box[BOXRIGHT] = v[j]->x;
+         if(v[j]->y < box[BOXBOTTOM]) box[BOXBOTTOM] = v[j]->y;
+         if(v[j]->y > box[BOXTOP])    box[BOXTOP] = v[j]->y;
+      }
+   }
+}
+
+
+static int buildNode(buildseg_t *segs, Uint32 count)
+{
+   bspnode_t part;
+   buildseg_t *front, *back;
+   Uint32 frontcount = 0, backcount = 0, i;
+   int nodenum;
+
+   if(!count)
+      return -1;
+
+   if(!choosePartition(segs, count, part))
+      return -1; // Nothing but degenerate segs left.
+
+   // Each seg can at most be split in two.
+   front = (buildseg_t *)malloc(sizeof(buildseg_t) * count * 2);
+   if(!front)
+      fatalError::Throw("buildNodes: out of memory splitting segs");
+   back = front + count;
+
+   part.firstseg = segcount;
+   part.segcount = 0;
+
+   for(i = 0; i < count; i++)
+   {
+      float d1, d2;
+
+      switch(classifySeg(part, segs[i], d1, d2))
+      {
+         case 0:
+            front[frontcount++] = segs[i];
+            break;
+         case 1:
+            back[backcount++] = segs[i];
+            break;
+         case 2:
+            addOutputSeg(segs[i]);
+            part.segcount++;
+            break;
+         default:
+         {
+            // Split the seg at the partition and keep the texture offset of the second
+            // piece continuous with the first.
+            mapvertex_t *v1 = getVertex(segs[i].v1), *v2 = getVertex(segs[i].v2);
+            float frac = d1 / (d1 - d2);
+            float nx = v1->x + (v2->x - v1->x) * frac;
+            float ny = v1->y + (v2->y - v1->y) * frac;
+            Uint32 nv = newVertex(nx, ny);
+            buildseg_t a = segs[i], b = segs[i];
+
+            // newVertex may have moved the split vertices, so refetch v1.
+            v1 = getVertex(segs[i].v1);
+
+            a.v2 = nv;
+            b.v1 = nv;
+            b.offset += (vector2f(nx, ny) - vector2f(v1->x, v1->y)).getLength();
+
+            if(d1 > 0)
+            {
+               front[frontcount++] = a;
+               back[backcount++] = b;
+            }
+            else
+            {
+               back[backcount++] = a;
+               front[frontcount++] = b;
+            }
+            break;
+         }
+      }
+   }
+
+   // Split vertices are on their segs, so the bounds of what goes down each side are the
+   // bounds of the whole subtree.
+   boundSegs(front, frontcount, part.bbox[0]);
+   boundSegs(back, backcount, part.bbox[1]);
+
+   nodenum = newNode();
+   int frontchild = buildNode(front, frontcount);
+   int backchild = buildNode(back, backcount);
+
+   free(front);
+
+   part.children[0] = frontchild;
+   part.children[1] = backchild;
+   nodelist[nodenum] = part;
+
+   return nodenum;
+}
+
+
+void buildNodes(void)
+{
+   buildseg_t *segs;
+   Uint32 i;
+
+   segs = (buildseg_t *)malloc(sizeof(buildseg_t) * (linecount ? linecount : 1));
+   if(!segs)
+      fatalError::Throw("buildNodes: out of memory allocating segs");
+
+   for(i = 0; i < linecount; i++)
+   {
+      segs[i].v1 = (Uint32)(linelist[i].v1 - vertexlist);
+      segs[i].v2 = (Uint32)(linelist[i].v2 - vertexlist);
+      segs[i].offset = 0.0f;
+      segs[i].line = linelist + i;
+   }
+
+   buildNode(segs, linecount);
+   free(segs);
+
+   // Everything is in place, so the vertex indices can now be turned into pointers.
+   seglist = (mapseg_t *)malloc(sizeof(mapseg_t) * (segcount ? segcount : 1));
+   if(!seglist)
+      fatalError::Throw("buildNodes: out of memory allocating segs");
+
+   for(i = 0; i < segcount; i++)
+   {
+      mapseg_t *seg = seglist + i;
+
+      seg->v1 = getVertex(outsegs[i].v1);
+      seg->v2 = getVertex(outsegs[i].v2);
+      seg->offset = outsegs[i].offset;
+      seg->line = outsegs[i].line;
+      seg->length = (vector2f(seg->v2->x, seg->v2->y) - vector2f(seg->v1->x, seg->v1->y)).getLength();
+   }
+
+   free(outsegs);
+   outsegs = NULL;
+   maxsegs = 0;
+}
@@ -0,0 +1,67 @@
+//
+// Copyright(C) 2007-2017 Stephen McGranahan
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/
+//
+// Purpose: BSP tree construction and front-to-back traversal
+// Authors: Stephen McGranahan
+//
+
+#pragma once
+
+#include "mapdata.h"
+
+// -- BSP node --
+// Every node partitions space along the line through (x, y) in the direction (dx, dy). All
+// segs that lie on the partition line are stored in the node itself, everything else is
+// pushed down into the two children. Child 0 is the front (right) side of the partition,
+// child 1 is the back side. A child of -1 means that side is empty.
+struct bspnode_t
+{
+   float    x, y, dx, dy;
+
+   Uint32   firstseg, segcount;
+
+   int      children[2];
+
+   // The bounds of every seg under each child, indexed by the BOX constants below. The
+   // renderer skips a child whose box is hidden behind closed columns.
+   float    bbox[2][4];
+};
+
+enum
+{
+   BOXTOP,
+   BOXBOTTOM,
+   BOXLEFT,
+   BOXRIGHT
+};
+
+
+extern Uint32     segcount;
+extern mapseg_t   *seglist;
+
+extern Uint32     nodecount;
+extern bspnode_t  *nodelist;
+
+// Vertices created when a line is split by a partition.
+extern Uint32     splitvertexcount;
+extern mapvertex_t *splitvertexlist;
+
+
+// Returns 0 if the point is on the front side of the node partition, otherwise 1.
+int pointOnSide(float x, float y, const bspnode_t *node);
+
+// Builds the BSP tree from linelist. Must be called after hackMapData.
+void buildNodes(void);
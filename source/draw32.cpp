@@ -139,7 +139,7 @@ void drawColumn(rendercolumn_t column)
 {
    Uint32 *source, *dest;
    int count;
-   unsigned sstep = view.width, ystep = column.ystep, texy = column.yfrac;
+   unsigned sstep = column.pitch, ystep = column.ystep, texy = column.yfrac;
    Uint16 r = column.blend.l_r, g = column.blend.l_g, b = column.blend.l_b;
    Uint32 fogadd = column.blend.fogadd;
 
@@ -163,37 +163,92 @@ void drawColumn(rendercolumn_t column)
 }
 
 
-void drawColumnChunk(rendercolumn_t *columns, void *destBuffer, int chunkWidth, int lowy, int highy, int startx)
+void drawColumnLow(rendercolumn_t column)
 {
-   unsigned int sstep = view.width;
+   Uint32 *source, *dest;
+   int count;
+   unsigned sstep = column.pitch, ystep = column.ystep, texy = column.yfrac;
+   Uint16 r = column.blend.l_r, g = column.blend.l_g, b = column.blend.l_b;
+   Uint32 fogadd = column.blend.fogadd;
+
+   if((count = column.y2 - column.y1 + 1) < 0)
+      return;
+
+   source = ((Uint32 *)column.tex) + column.texx;
+   dest = ((Uint32 *)column.screen) + (column.y1 * sstep) + (column.x << 1);
+
+   while(count--)
+   {
+      Uint32 texl = source[(texy >> 16) & 0x3f];
 
+      dest[0] = dest[1] = (((((texl & 0xFF) * b)
+         | (((texl & 0xFF00) * g) & 0xFF0000)
+         | ((texl * r) & 0xFF000000))) >> 8) + fogadd;
+
+      dest += sstep;
+      texy += ystep;
+   }
+}
+
+
+void drawColumnChunk(rendercolumn_t *columns, void *destBuffer, int pitch, int chunkWidth, int lowy, int highy, int startx)
+{
    for (int y = lowy; y < highy; ++y)
    {
-      Uint32* dest = ((Uint32*)destBuffer) + (y * view.width) + startx;
+      Uint32* dest = ((Uint32*)destBuffer) + (y * pitch) + startx;
 
       for (int i = 0; i < chunkWidth; ++i)
       {
-         if (y < columns[i].y1 || y > columns[i].y2) goto skip;
+         if (y >= columns[i].y1 && y <= columns[i].y2)
+         {
+            Uint32* source = (Uint32*)columns[i].tex;
+            Uint16 r = columns[i].blend.l_r, g = columns[i].blend.l_g, b = columns[i].blend.l_b;
+            Uint32 fogadd = columns[i].blend.fogadd;
 
-         Uint32* source = (Uint32*)columns[i].tex;
-         Uint16 r = columns[i].blend.l_r, g = columns[i].blend.l_g, b = columns[i].blend.l_b;
-         Uint32 fogadd = columns[i].blend.fogadd;
+            Uint32 texl = source[(columns[i].yfrac >> 16) & 0x3f];
 
-         Uint32 texl = source[(columns[i].yfrac >> 16) & 0x3f];
+            *dest = ((((texl & 0xFF) * b)
+               | (((texl & 0xFF00) * g) & 0xFF0000)
+               | ((texl * r) & 0xFF000000)) >> 8) + fogadd;
 
-         *dest = ((((texl & 0xFF) * b)
-            | (((texl & 0xFF00) * g) & 0xFF0000)
-            | ((texl * r) & 0xFF000000)) >> 8) + fogadd;
+            columns[i].yfrac += columns[i].ystep;
+         }
 
-         columns[i].yfrac += columns[i].ystep;
-
-      skip:
          dest++;
       }
    }
 }
 
 
+void drawColumnChunkLow(rendercolumn_t *columns, void *destBuffer, int pitch, int chunkWidth, int lowy, int highy, int startx)
+{
+   for (int y = lowy; y < highy; ++y)
+   {
+      Uint32* dest = ((Uint32*)destBuffer) + (y * pitch) + (startx << 1);
+
+      for (int i = 0; i < chunkWidth; ++i)
+      {
+         if (y >= columns[i].y1 && y <= columns[i].y2)
+         {
+            Uint32* source = (Uint32*)columns[i].tex;
+            Uint16 r = columns[i].blend.l_r, g = columns[i].blend.l_g, b = columns[i].blend.l_b;
+            Uint32 fogadd = columns[i].blend.fogadd;
+
+            Uint32 texl = source[(columns[i].yfrac >> 16) & 0x3f];
+
+            dest[0] = dest[1] = ((((texl & 0xFF) * b)
+               | (((texl & 0xFF00) * g) & 0xFF0000)
+               | ((texl * r) & 0xFF000000)) >> 8) + fogadd;
+
+            columns[i].yfrac += columns[i].ystep;
+         }
+
+         dest += 2;
+      }
+   }
+}
+
+
 // -- Span drawing --
 void drawSpan(renderspan_t span)
 {
@@ -207,7 +262,7 @@ void drawSpan(renderspan_t span)
       return;
 
    Uint32 *source = (Uint32 *)span.tex;
-   Uint32 *dest = (Uint32 *)span.screen + (span.y * view.width) + span.x1;
+   Uint32 *dest = (Uint32 *)span.screen + (span.y * span.pitch) + span.x1;
 
    while(count--)
    {
@@ -223,7 +278,37 @@ void drawSpan(renderspan_t span)
    }
 }
 
-void drawSlopedSpan(rslopespan_t slopespan)
+void drawSpanLow(renderspan_t span)
+{
+   unsigned xf = span.xfrac, xs = span.xstep;
+   unsigned yf = span.yfrac, ys = span.ystep;
+   int count;
+   Uint16 r = span.blend.l_r, g = span.blend.l_g, b = span.blend.l_b;
+   Uint32 fogadd = span.blend.fogadd;
+
+   if((count = span.x2 - span.x1 + 1) < 0)
+      return;
+
+   Uint32 *source = (Uint32 *)span.tex;
+   Uint32 *dest = (Uint32 *)span.screen + (span.y * span.pitch) + (span.x1 << 1);
+
+   while(count--)
+   {
+      Uint32 texl = source[((xf >> 16) & 63) * 64 + ((yf >> 16) & 63)];
+
+      dest[0] = dest[1] = (((((texl & 0xFF) * b)
+         | (((texl & 0xFF00) * g) & 0xFF0000)
+         | ((texl * r) & 0xFF000000))) >> 8) + fogadd;
+
+      dest += 2;
+      xf += xs;
+      yf += ys;
+   }
+}
+
+// Both sloped span drawers. With a detailshift of 1 every pixel is written twice. This is
+// inlined into each with a constant detailshift, so neither pays for the other.
+static inline void slopedSpan(const rslopespan_t &slopespan, int detailshift)
 {
    float iu = slopespan.iufrac, iv = slopespan.ivfrac;
    float ius = slopespan.iustep, ivs = slopespan.ivstep;
@@ -241,7 +326,7 @@ void drawSlopedSpan(rslopespan_t slopespan)
    b = slopespan.bfrac; bs = slopespan.bstep;
 
    Uint32 *src = (Uint32 *)slopespan.src;
-   Uint32 *dest = (Uint32 *)slopespan.dest + (slopespan.y * view.width) + slopespan.x1;
+   Uint32 *dest = (Uint32 *)slopespan.dest + (slopespan.y * slopespan.pitch) + (slopespan.x1 << detailshift);
 
 #if 0
    // Perfect *slow* render
@@ -256,7 +341,9 @@ void drawSlopedSpan(rslopespan_t slopespan)
       *dest = ((((src[texl] & 0xFF) * (b >> 16))
          | (((src[texl] & 0xFF00) * (g >> 16)) & 0xFF0000)
          | ((src[texl] * (r >> 16)) & 0xFF000000))) >> 8;
-      dest++;
+      if(detailshift)
+         dest[1] = *dest;
+      dest += 1 << detailshift;
 
       iu += ius;
       iv += ivs;
@@ -298,7 +385,9 @@ void drawSlopedSpan(rslopespan_t slopespan)
          *dest = ((((texl & 0xFF) * (b >> 16))
             | (((texl & 0xFF00) * (g >> 16)) & 0xFF0000)
             | ((texl * (r >> 16)) & 0xFF000000))) >> 8;
-         dest++;
+         if(detailshift)
+            dest[1] = *dest;
+         dest += 1 << detailshift;
 
          ufrac += ustep;
          vfrac += vstep;
@@ -339,7 +428,9 @@ void drawSlopedSpan(rslopespan_t slopespan)
          *dest = ((((texl & 0xFF) * (b >> 16))
             | (((texl & 0xFF00) * (g >> 16)) & 0xFF0000)
             | ((texl * (r >> 16)) & 0xFF000000))) >> 8;
-         dest++;
+         if(detailshift)
+            dest[1] = *dest;
+         dest += 1 << detailshift;
 
          ufrac += ustep;
          vfrac += vstep;
@@ -350,3 +441,118 @@ void drawSlopedSpan(rslopespan_t slopespan)
    }
 #endif
 }
+
+
+void drawSlopedSpan(rslopespan_t slopespan)
+{
+   slopedSpan(slopespan, 0);
+}
+
+
+void drawSlopedSpanLow(rslopespan_t slopespan)
+{
+   slopedSpan(slopespan, 1);
+}
+
+
+// -- Drawer selection --
+static int simdlevel = -1;
+
+int getMaxSIMDLevel(void)
+{
+#ifdef CARDBOARD_SIMD
+   if(SDL_HasAVX2())
+      return SIMD_AVX2;
+   if(SDL_HasSSE41())
+      return SIMD_SSE41;
+#endif
+   return SIMD_NONE;
+}
+
+
+int getSIMDLevel(void)
+{
+   if(simdlevel < 0)
+      simdlevel = getMaxSIMDLevel();
+
+   return simdlevel;
+}
+
+
+void setSIMDLevel(int level)
+{
+   int maxlevel = getMaxSIMDLevel();
+
+   simdlevel = level < SIMD_NONE ? SIMD_NONE : level > maxlevel ? maxlevel : level;
+}
+
+
+const char *getSIMDLevelName(int level)
+{
+   static const char *names[NUMSIMDLEVELS] = {"none", "sse4.1", "avx2"};
+
+   return level >= 0 && level < NUMSIMDLEVELS ? names[level] : "";
+}
+
+
+chunkfunc_t getChunkDrawer(int detailshift)
+{
+   if(detailshift)
+      return drawColumnChunkLow;
+
+#ifdef CARDBOARD_SIMD
+   switch(getSIMDLevel())
+   {
+      case SIMD_AVX2:
+         return drawColumnChunkAVX2;
+      case SIMD_SSE41:
+         return drawColumnChunkSSE41;
+      default:
+         break;
+   }
+#endif
+
+   return drawColumnChunk;
+}
+
+
+spanfunc_t getSpanDrawer(int detailshift)
+{
+   if(detailshift)
+      return drawSpanLow;
+
+#ifdef CARDBOARD_SIMD
+   switch(getSIMDLevel())
+   {
+      case SIMD_AVX2:
+         return drawSpanAVX2;
+      case SIMD_SSE41:
+         return drawSpanSSE41;
+      default:
+         break;
+   }
+#endif
+
+   return drawSpan;
+}
+
+
+slopespanfunc_t getSlopedSpanDrawer(int detailshift)
+{
+   if(detailshift)
+      return drawSlopedSpanLow;
+
+#ifdef CARDBOARD_SIMD
+   switch(getSIMDLevel())
+   {
+      case SIMD_AVX2:
+         return drawSlopedSpanAVX2;
+      case SIMD_SSE41:
+         return drawSlopedSpanSSE41;
+      default:
+         break;
+   }
+#endif
+
+   return drawSlopedSpan;
+}
@@ -0,0 +1,129 @@
+//
+// Copyright(C) 2007-2017 Stephen McGranahan
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/
+//
+// Purpose: 32-bit rendering functions
+// Authors: Stephen McGranahan
+//
+
+#pragma once
+
+#include "light.h"
+
+// -- Rendering --
+struct slopelightblend_t
+{
+	float rf, gf, bf;
+	Uint32 fogadd;
+};
+
+struct rendercolumn_t
+{
+   int x;
+   int y1, y2;
+   int yfrac, ystep;
+   int texx;
+
+   lightblend_t blend;
+
+   // screen is the top left of the target, pitch is in pixels.
+   void *tex, *screen;
+   int  pitch;
+};
+
+
+struct renderspan_t
+{
+   int x1, x2, y;
+   int xfrac, yfrac, xstep, ystep;
+
+   lightblend_t blend;
+
+   void *tex, *screen;
+   int  pitch;
+};
+
+
+struct rslopespan_t
+{
+   int x1, x2, y;
+   float iufrac, ivfrac, idfrac;
+   float iustep, ivstep, idstep;
+
+   int rfrac, gfrac, bfrac;
+   int rstep, gstep, bstep;
+
+   slopelightblend_t blend;
+
+   void *src, *dest;
+   int  pitch;
+};
+
+
+// -- bit-specific functions --
+Uint32 getFogColor(Uint16 level, Uint8 r, Uint8 g, Uint8 b);
+slopelightblend_t calcSlopeLight(float distance, float map, light_t light);
+lightblend_t calcLight(float distance, float map, light_t light);
+void drawColumnChunk(rendercolumn_t* columns, void* destBuffer, int pitch, int chunkWidth, int lowy, int highy, int startx);
+void drawColumn(rendercolumn_t column);
+void drawSpan(renderspan_t span);
+void drawSlopedSpan(rslopespan_t slopespan);
+
+// Low detail versions of the above, like doom's. x coordinates are in half resolution
+// columns and every pixel is written twice, to 2x and 2x + 1.
+void drawColumnChunkLow(rendercolumn_t* columns, void* destBuffer, int pitch, int chunkWidth, int lowy, int highy, int startx);
+void drawColumnLow(rendercolumn_t column);
+void drawSpanLow(renderspan_t span);
+void drawSlopedSpanLow(rslopespan_t slopespan);
+
+typedef void (*chunkfunc_t)(rendercolumn_t* columns, void* destBuffer, int pitch, int chunkWidth, int lowy, int highy, int startx);
+typedef void (*colfunc_t)(rendercolumn_t column);
+typedef void (*spanfunc_t)(renderspan_t span);
+typedef void (*slopespanfunc_t)(rslopespan_t slopespan);
+
+// -- SIMD drawers --
+// Versions of the drawers for newer x86 CPUs, in draw32_sse41.cpp and draw32_avx2.cpp. They
+// draw exactly what the plain versions do. They are only built when CARDBOARD_SIMD is
+// defined and may only be called when the CPU has the instructions, so the renderer gets its
+// drawers from the functions below.
+#ifdef CARDBOARD_SIMD
+void drawColumnChunkSSE41(rendercolumn_t* columns, void* destBuffer, int pitch, int chunkWidth, int lowy, int highy, int startx);
+void drawColumnChunkAVX2(rendercolumn_t* columns, void* destBuffer, int pitch, int chunkWidth, int lowy, int highy, int startx);
+void drawSpanSSE41(renderspan_t span);
+void drawSpanAVX2(renderspan_t span);
+void drawSlopedSpanSSE41(rslopespan_t slopespan);
+void drawSlopedSpanAVX2(rslopespan_t slopespan);
+#endif
+
+enum
+{
+   SIMD_NONE,
+   SIMD_SSE41,
+   SIMD_AVX2,
+   NUMSIMDLEVELS
+};
+
+// The newest instruction set the drawers may use. It starts out as the best the CPU (and
+// the build) supports and can only be lowered from there. Contexts pick up a change the next
+// time their view is set up.
+int getSIMDLevel(void);
+int getMaxSIMDLevel(void);
+void setSIMDLevel(int level);
+const char *getSIMDLevelName(int level);
+
+// The fastest drawers for the SIMD level and detail level.
+chunkfunc_t getChunkDrawer(int detailshift);
+spanfunc_t getSpanDrawer(int detailshift);
+slopespanfunc_t getSlopedSpanDrawer(int detailshift);
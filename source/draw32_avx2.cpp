@@ -0,0 +1,337 @@
+//
+// Copyright(C) 2007-2017 Stephen McGranahan
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/
+//
+// Purpose: 32-bit drawers using AVX2
+// Authors: Stephen McGranahan
+//
+
+#include <SDL.h>
+#include <limits.h>
+#include <immintrin.h>
+#include "draw32.h"
+
+// Everything in here is built with AVX2 enabled, so nothing in it may be called unless the
+// CPU has it. Only draw32.h is included to keep other inline code from being built for AVX2.
+
+
+// Draws the chunk 8 columns at a time, one column per lane. A lane only writes (and steps
+// its yfrac) on the rows its column covers, exactly like the plain version.
+void drawColumnChunkAVX2(rendercolumn_t *columns, void *destBuffer, int pitch, int chunkWidth, int lowy, int highy, int startx)
+{
+   const __m256i texmask = _mm256_set1_epi32(63);
+   const __m256i bluemask = _mm256_set1_epi32(0xFF);
+   const __m256i greenmask = _mm256_set1_epi32(0xFF00);
+   const __m256i greenbits = _mm256_set1_epi32(0xFF0000);
+   const __m256i redbits = _mm256_set1_epi32((int)0xFF000000);
+   const __m256i ones = _mm256_set1_epi32(-1);
+
+   for(int first = 0; first < chunkWidth; first += 8)
+   {
+      rendercolumn_t *c = columns + first;
+      int lanes = chunkWidth - first < 8 ? chunkWidth - first : 8;
+      const Uint32 *base = NULL;
+      alignas(32) int y1[8], y2[8], yfrac[8], ystep[8], texoff[8];
+      alignas(32) int r[8], g[8], b[8], fogadd[8];
+      int top = INT_MAX, bottom = INT_MIN;
+
+      // Columns that draw nothing may not have a texture set, so the texels are addressed
+      // from the first one that draws.
+      for(int i = 0; i < lanes && !base; i++)
+      {
+         if(c[i].y1 <= c[i].y2)
+            base = (const Uint32 *)c[i].tex;
+      }
+
+      if(!base)
+         continue;
+
+      // Unused lanes get an empty range, so they never write.
+      for(int i = 0; i < 8; i++)
+      {
+         if(i < lanes && c[i].y1 <= c[i].y2)
+         {
+            y1[i] = c[i].y1;
+            y2[i] = c[i].y2;
+            yfrac[i] = c[i].yfrac;
+            ystep[i] = c[i].ystep;
+            // Every column points into the same texture, so the offsets are small.
+            texoff[i] = (int)((const Uint32 *)c[i].tex - base);
+            r[i] = c[i].blend.l_r;
+            g[i] = c[i].blend.l_g;
+            b[i] = c[i].blend.l_b;
+            fogadd[i] = (int)c[i].blend.fogadd;
+
+            if(y1[i] < top) top = y1[i];
+            if(y2[i] > bottom) bottom = y2[i];
+         }
+         else
+         {
+            y1[i] = INT_MAX;
+            y2[i] = INT_MIN;
+            yfrac[i] = ystep[i] = texoff[i] = 0;
+            r[i] = g[i] = b[i] = fogadd[i] = 0;
+         }
+      }
+
+      // Rows no lane covers don't change anything.
+      if(top < lowy)
+         top = lowy;
+      if(bottom > highy - 1)
+         bottom = highy - 1;
+
+      __m256i y1v = _mm256_load_si256((const __m256i *)y1);
+      __m256i y2v = _mm256_load_si256((const __m256i *)y2);
+      __m256i yfracv = _mm256_load_si256((const __m256i *)yfrac);
+      __m256i ystepv = _mm256_load_si256((const __m256i *)ystep);
+      __m256i texoffv = _mm256_load_si256((const __m256i *)texoff);
+      __m256i rv = _mm256_load_si256((const __m256i *)r);
+      __m256i gv = _mm256_load_si256((const __m256i *)g);
+      __m256i bv = _mm256_load_si256((const __m256i *)b);
+      __m256i fogv = _mm256_load_si256((const __m256i *)fogadd);
+
+      Uint32 *dest = (Uint32 *)destBuffer + (top * pitch) + startx + first;
+
+      for(int y = top; y <= bottom; y++, dest += pitch)
+      {
+         __m256i yv = _mm256_set1_epi32(y);
+         __m256i outside = _mm256_or_si256(_mm256_cmpgt_epi32(y1v, yv), _mm256_cmpgt_epi32(yv, y2v));
+         __m256i active = _mm256_xor_si256(outside, ones);
+
+         if(_mm256_testz_si256(active, active))
+            continue;
+
+         __m256i index = _mm256_add_epi32(texoffv, _mm256_and_si256(_mm256_srai_epi32(yfracv, 16), texmask));
+         __m256i texl = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int *)base, index, active, 4);
+
+         // The same three multiplies as the plain drawer, carries and all.
+         __m256i blue = _mm256_mullo_epi32(_mm256_and_si256(texl, bluemask), bv);
+         __m256i green = _mm256_and_si256(_mm256_mullo_epi32(_mm256_and_si256(texl, greenmask), gv), greenbits);
+         __m256i red = _mm256_and_si256(_mm256_mullo_epi32(texl, rv), redbits);
+         __m256i pixel = _mm256_or_si256(_mm256_or_si256(blue, green), red);
+
+         pixel = _mm256_add_epi32(_mm256_srli_epi32(pixel, 8), fogv);
+
+         _mm256_maskstore_epi32((int *)dest, active, pixel);
+
+         yfracv = _mm256_add_epi32(yfracv, _mm256_and_si256(ystepv, active));
+      }
+   }
+}
+
+
+// Draws the span 8 pixels at a time with aligned stores. The pixels before the first 32 byte
+// boundary and the ones left at the end go to the plain drawer.
+void drawSpanAVX2(renderspan_t span)
+{
+   int count, head, body;
+
+   if((count = span.x2 - span.x1 + 1) <= 0)
+      return;
+
+   Uint32 *dest = (Uint32 *)span.screen + (span.y * span.pitch) + span.x1;
+
+   head = (int)((32 - ((size_t)dest & 31)) & 31) >> 2;
+   if(head > count)
+      head = count;
+   body = (count - head) & ~7;
+
+   if(head)
+   {
+      renderspan_t part = span;
+
+      part.x2 = span.x1 + head - 1;
+      drawSpan(part);
+   }
+
+   const Uint32 *source = (const Uint32 *)span.tex;
+   unsigned xs = span.xstep, ys = span.ystep;
+   unsigned xf = span.xfrac + head * xs, yf = span.yfrac + head * ys;
+
+   if(body)
+   {
+      const __m256i texmask = _mm256_set1_epi32(63);
+      const __m256i bluemask = _mm256_set1_epi32(0xFF);
+      const __m256i greenmask = _mm256_set1_epi32(0xFF00);
+      const __m256i greenbits = _mm256_set1_epi32(0xFF0000);
+      const __m256i redbits = _mm256_set1_epi32((int)0xFF000000);
+      const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+      const __m256i rv = _mm256_set1_epi32(span.blend.l_r);
+      const __m256i gv = _mm256_set1_epi32(span.blend.l_g);
+      const __m256i bv = _mm256_set1_epi32(span.blend.l_b);
+      const __m256i fogv = _mm256_set1_epi32((int)span.blend.fogadd);
+
+      // Lane i starts i steps in. The fractions wrap the same way the plain drawer's do.
+      __m256i xfv = _mm256_add_epi32(_mm256_set1_epi32((int)xf), _mm256_mullo_epi32(lane, _mm256_set1_epi32(span.xstep)));
+      __m256i yfv = _mm256_add_epi32(_mm256_set1_epi32((int)yf), _mm256_mullo_epi32(lane, _mm256_set1_epi32(span.ystep)));
+      const __m256i xsv = _mm256_set1_epi32((int)(xs * 8));
+      const __m256i ysv = _mm256_set1_epi32((int)(ys * 8));
+
+      Uint32 *d = dest + head;
+
+      for(int i = 0; i < body; i += 8, d += 8)
+      {
+         __m256i index = _mm256_add_epi32(
+            _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(xfv, 16), texmask), 6),
+            _mm256_and_si256(_mm256_srli_epi32(yfv, 16), texmask));
+         __m256i texl = _mm256_i32gather_epi32((const int *)source, index, 4);
+
+         __m256i blue = _mm256_mullo_epi32(_mm256_and_si256(texl, bluemask), bv);
+         __m256i green = _mm256_and_si256(_mm256_mullo_epi32(_mm256_and_si256(texl, greenmask), gv), greenbits);
+         __m256i red = _mm256_and_si256(_mm256_mullo_epi32(texl, rv), redbits);
+         __m256i pixel = _mm256_or_si256(_mm256_or_si256(blue, green), red);
+
+         _mm256_store_si256((__m256i *)d, _mm256_add_epi32(_mm256_srli_epi32(pixel, 8), fogv));
+
+         xfv = _mm256_add_epi32(xfv, xsv);
+         yfv = _mm256_add_epi32(yfv, ysv);
+      }
+
+      xf += body * xs;
+      yf += body * ys;
+   }
+
+   if(head + body < count)
+   {
+      renderspan_t part = span;
+
+      part.x1 = span.x1 + head + body;
+      part.xfrac = (int)xf;
+      part.yfrac = (int)yf;
+      drawSpan(part);
+   }
+}
+
+
+// Draws the sloped span 16 pixel segment by segment like the plain drawer, but works out the
+// ends of 8 segments with one divide and draws each segment 8 pixels at a time. The points
+// are stepped one after another first, the same way the plain drawer steps them, so u and v
+// come out exactly the same. Whatever is left after the last whole segment goes to the plain
+// drawer.
+void drawSlopedSpanAVX2(rslopespan_t slopespan)
+{
+   int count, segments;
+
+   if((count = slopespan.x2 - slopespan.x1 + 1) < 16)
+   {
+      drawSlopedSpan(slopespan);
+      return;
+   }
+
+   float iu = slopespan.iufrac, iv = slopespan.ivfrac, id = slopespan.idfrac;
+   float ius = slopespan.iustep, ivs = slopespan.ivstep, ids = slopespan.idstep;
+
+   const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+   const __m256i mask6 = _mm256_set1_epi32(0x3F);
+   const __m256i maskv = _mm256_set1_epi32(0xFC0);
+   const __m256i bluemask = _mm256_set1_epi32(0xFF);
+   const __m256i greenmask = _mm256_set1_epi32(0xFF00);
+   const __m256i greenbits = _mm256_set1_epi32(0xFF0000);
+   const __m256i redbits = _mm256_set1_epi32((int)0xFF000000);
+   const __m256 fracunit = _mm256_set1_ps(65536.0f);
+   const __m256 interpstep = _mm256_set1_ps(1.0f / 16.0f);
+
+   // The light is stepped per pixel the whole way across.
+   __m256i rv = _mm256_add_epi32(_mm256_set1_epi32(slopespan.rfrac), _mm256_mullo_epi32(lane, _mm256_set1_epi32(slopespan.rstep)));
+   __m256i gv = _mm256_add_epi32(_mm256_set1_epi32(slopespan.gfrac), _mm256_mullo_epi32(lane, _mm256_set1_epi32(slopespan.gstep)));
+   __m256i bv = _mm256_add_epi32(_mm256_set1_epi32(slopespan.bfrac), _mm256_mullo_epi32(lane, _mm256_set1_epi32(slopespan.bstep)));
+   const __m256i rs8 = _mm256_set1_epi32((int)((unsigned)slopespan.rstep * 8));
+   const __m256i gs8 = _mm256_set1_epi32((int)((unsigned)slopespan.gstep * 8));
+   const __m256i bs8 = _mm256_set1_epi32((int)((unsigned)slopespan.bstep * 8));
+
+   const Uint32 *src = (const Uint32 *)slopespan.src;
+   Uint32 *dest = (Uint32 *)slopespan.dest + (slopespan.y * slopespan.pitch) + slopespan.x1;
+
+   for(segments = count >> 4; segments > 0; )
+   {
+      int n = segments < 8 ? segments : 8;
+      alignas(32) float ds[16], us[16], vs[16];
+      alignas(32) int ufrac[8], ustep[8], vfrac[8], vstep[8];
+
+      for(int i = 0; i <= n; i++)
+      {
+         ds[i] = id;
+         us[i] = iu;
+         vs[i] = iv;
+
+         if(i < n)
+         {
+            id += ids * 16;
+            iu += ius * 16;
+            iv += ivs * 16;
+         }
+      }
+      for(int i = n + 1; i < 16; i++)
+      {
+         ds[i] = 1.0f;
+         us[i] = vs[i] = 0.0f;
+      }
+
+      __m256 mulstart = _mm256_div_ps(fracunit, _mm256_load_ps(ds));
+      __m256 mulend = _mm256_div_ps(fracunit, _mm256_loadu_ps(ds + 1));
+      __m256 ustart = _mm256_mul_ps(_mm256_load_ps(us), mulstart);
+      __m256 uend = _mm256_mul_ps(_mm256_loadu_ps(us + 1), mulend);
+      __m256 vstart = _mm256_mul_ps(_mm256_load_ps(vs), mulstart);
+      __m256 vend = _mm256_mul_ps(_mm256_loadu_ps(vs + 1), mulend);
+
+      _mm256_store_si256((__m256i *)ufrac, _mm256_cvttps_epi32(ustart));
+      _mm256_store_si256((__m256i *)vfrac, _mm256_cvttps_epi32(vstart));
+      _mm256_store_si256((__m256i *)ustep, _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_sub_ps(uend, ustart), interpstep)));
+      _mm256_store_si256((__m256i *)vstep, _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_sub_ps(vend, vstart), interpstep)));
+
+      for(int s = 0; s < n; s++)
+      {
+         __m256i uv = _mm256_add_epi32(_mm256_set1_epi32(ufrac[s]), _mm256_mullo_epi32(lane, _mm256_set1_epi32(ustep[s])));
+         __m256i vv = _mm256_add_epi32(_mm256_set1_epi32(vfrac[s]), _mm256_mullo_epi32(lane, _mm256_set1_epi32(vstep[s])));
+         const __m256i us8 = _mm256_set1_epi32((int)((unsigned)ustep[s] * 8));
+         const __m256i vs8 = _mm256_set1_epi32((int)((unsigned)vstep[s] * 8));
+
+         for(int half = 0; half < 2; half++, dest += 8)
+         {
+            __m256i index = _mm256_add_epi32(
+               _mm256_and_si256(_mm256_srai_epi32(vv, 10), maskv),
+               _mm256_and_si256(_mm256_srai_epi32(uv, 16), mask6));
+            __m256i texl = _mm256_i32gather_epi32((const int *)src, index, 4);
+
+            __m256i blue = _mm256_mullo_epi32(_mm256_and_si256(texl, bluemask), _mm256_srai_epi32(bv, 16));
+            __m256i green = _mm256_and_si256(_mm256_mullo_epi32(_mm256_and_si256(texl, greenmask), _mm256_srai_epi32(gv, 16)), greenbits);
+            __m256i red = _mm256_and_si256(_mm256_mullo_epi32(texl, _mm256_srai_epi32(rv, 16)), redbits);
+            __m256i pixel = _mm256_or_si256(_mm256_or_si256(blue, green), red);
+
+            _mm256_storeu_si256((__m256i *)dest, _mm256_srli_epi32(pixel, 8));
+
+            uv = _mm256_add_epi32(uv, us8);
+            vv = _mm256_add_epi32(vv, vs8);
+            rv = _mm256_add_epi32(rv, rs8);
+            gv = _mm256_add_epi32(gv, gs8);
+            bv = _mm256_add_epi32(bv, bs8);
+         }
+      }
+
+      segments -= n;
+   }
+
+   if(count & 15)
+   {
+      slopespan.x1 += count & ~15;
+      slopespan.iufrac = iu;
+      slopespan.ivfrac = iv;
+      slopespan.idfrac = id;
+      slopespan.rfrac = _mm256_cvtsi256_si32(rv);
+      slopespan.gfrac = _mm256_cvtsi256_si32(gv);
+      slopespan.bfrac = _mm256_cvtsi256_si32(bv);
+      drawSlopedSpan(slopespan);
+   }
+}
@@ -0,0 +1,352 @@
+//
+// Copyright(C) 2007-2017 Stephen McGranahan
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/
+//
+// Purpose: 32-bit drawers using SSE4.1
+// Authors: Stephen McGranahan
+//
+
+#include <SDL.h>
+#include <limits.h>
+#include <smmintrin.h>
+#include "draw32.h"
+
+// Everything in here is built with SSE4.1 enabled, so nothing in it may be called unless the
+// CPU has it. Only draw32.h is included to keep other inline code from being built for SSE4.1.
+
+
+// Draws the chunk 4 columns at a time, one column per lane. The destination is never read,
+// since it may be write-combined texture memory: rows every lane covers are stored whole and
+// the rest a pixel at a time. Any columns left over after the last group of 4 go to the
+// plain drawer.
+void drawColumnChunkSSE41(rendercolumn_t *columns, void *destBuffer, int pitch, int chunkWidth, int lowy, int highy, int startx)
+{
+   const __m128i texmask = _mm_set1_epi32(63);
+   const __m128i bluemask = _mm_set1_epi32(0xFF);
+   const __m128i greenmask = _mm_set1_epi32(0xFF00);
+   const __m128i greenbits = _mm_set1_epi32(0xFF0000);
+   const __m128i redbits = _mm_set1_epi32((int)0xFF000000);
+   int first;
+
+   for(first = 0; first + 4 <= chunkWidth; first += 4)
+   {
+      rendercolumn_t *c = columns + first;
+      const Uint32 *src[4], *fallback = NULL;
+      int y1[4], y2[4];
+      int top = INT_MAX, bottom = INT_MIN;
+
+      // Columns that draw nothing may not have a texture set. They get an empty range and
+      // read from one of the others.
+      for(int i = 0; i < 4; i++)
+      {
+         if(c[i].y1 <= c[i].y2)
+         {
+            y1[i] = c[i].y1;
+            y2[i] = c[i].y2;
+            src[i] = (const Uint32 *)c[i].tex;
+            if(!fallback)
+               fallback = src[i];
+
+            if(y1[i] < top) top = y1[i];
+            if(y2[i] > bottom) bottom = y2[i];
+         }
+         else
+         {
+            y1[i] = INT_MAX;
+            y2[i] = INT_MIN;
+            src[i] = NULL;
+         }
+      }
+
+      if(!fallback)
+         continue;
+
+      for(int i = 0; i < 4; i++)
+      {
+         if(!src[i])
+            src[i] = fallback;
+      }
+
+      // Rows no lane covers don't change anything.
+      if(top < lowy)
+         top = lowy;
+      if(bottom > highy - 1)
+         bottom = highy - 1;
+
+      __m128i y1v = _mm_setr_epi32(y1[0], y1[1], y1[2], y1[3]);
+      __m128i y2v = _mm_setr_epi32(y2[0], y2[1], y2[2], y2[3]);
+      __m128i yfracv = _mm_setr_epi32(c[0].yfrac, c[1].yfrac, c[2].yfrac, c[3].yfrac);
+      __m128i ystepv = _mm_setr_epi32(c[0].ystep, c[1].ystep, c[2].ystep, c[3].ystep);
+      __m128i rv = _mm_setr_epi32(c[0].blend.l_r, c[1].blend.l_r, c[2].blend.l_r, c[3].blend.l_r);
+      __m128i gv = _mm_setr_epi32(c[0].blend.l_g, c[1].blend.l_g, c[2].blend.l_g, c[3].blend.l_g);
+      __m128i bv = _mm_setr_epi32(c[0].blend.l_b, c[1].blend.l_b, c[2].blend.l_b, c[3].blend.l_b);
+      __m128i fogv = _mm_setr_epi32(c[0].blend.fogadd, c[1].blend.fogadd, c[2].blend.fogadd, c[3].blend.fogadd);
+
+      Uint32 *dest = (Uint32 *)destBuffer + (top * pitch) + startx + first;
+
+      for(int y = top; y <= bottom; y++, dest += pitch)
+      {
+         __m128i yv = _mm_set1_epi32(y);
+         __m128i outside = _mm_or_si128(_mm_cmpgt_epi32(y1v, yv), _mm_cmpgt_epi32(yv, y2v));
+         int skip = _mm_movemask_ps(_mm_castsi128_ps(outside));
+
+         if(skip == 0xF)
+            continue;
+
+         alignas(16) int index[4];
+         _mm_store_si128((__m128i *)index, _mm_and_si128(_mm_srai_epi32(yfracv, 16), texmask));
+
+         __m128i texl = _mm_setr_epi32(src[0][index[0]], src[1][index[1]], src[2][index[2]], src[3][index[3]]);
+
+         // The same three multiplies as the plain drawer, carries and all.
+         __m128i blue = _mm_mullo_epi32(_mm_and_si128(texl, bluemask), bv);
+         __m128i green = _mm_and_si128(_mm_mullo_epi32(_mm_and_si128(texl, greenmask), gv), greenbits);
+         __m128i red = _mm_and_si128(_mm_mullo_epi32(texl, rv), redbits);
+         __m128i pixel = _mm_or_si128(_mm_or_si128(blue, green), red);
+
+         pixel = _mm_add_epi32(_mm_srli_epi32(pixel, 8), fogv);
+
+         if(!skip)
+            _mm_storeu_si128((__m128i *)dest, pixel);
+         else
+         {
+            alignas(16) Uint32 out[4];
+            _mm_store_si128((__m128i *)out, pixel);
+
+            for(int i = 0; i < 4; i++)
+            {
+               if(!(skip & (1 << i)))
+                  dest[i] = out[i];
+            }
+         }
+
+         yfracv = _mm_add_epi32(yfracv, _mm_andnot_si128(outside, ystepv));
+      }
+   }
+
+   if(first < chunkWidth)
+      drawColumnChunk(columns + first, destBuffer, pitch, chunkWidth - first, lowy, highy, startx + first);
+}
+
+
+// Draws the span 4 pixels at a time with aligned stores. The pixels before the first 16 byte
+// boundary and the ones left at the end go to the plain drawer.
+void drawSpanSSE41(renderspan_t span)
+{
+   int count, head, body;
+
+   if((count = span.x2 - span.x1 + 1) <= 0)
+      return;
+
+   Uint32 *dest = (Uint32 *)span.screen + (span.y * span.pitch) + span.x1;
+
+   head = (int)((16 - ((size_t)dest & 15)) & 15) >> 2;
+   if(head > count)
+      head = count;
+   body = (count - head) & ~3;
+
+   if(head)
+   {
+      renderspan_t part = span;
+
+      part.x2 = span.x1 + head - 1;
+      drawSpan(part);
+   }
+
+   const Uint32 *source = (const Uint32 *)span.tex;
+   unsigned xs = span.xstep, ys = span.ystep;
+   unsigned xf = span.xfrac + head * xs, yf = span.yfrac + head * ys;
+
+   if(body)
+   {
+      const __m128i texmask = _mm_set1_epi32(63);
+      const __m128i bluemask = _mm_set1_epi32(0xFF);
+      const __m128i greenmask = _mm_set1_epi32(0xFF00);
+      const __m128i greenbits = _mm_set1_epi32(0xFF0000);
+      const __m128i redbits = _mm_set1_epi32((int)0xFF000000);
+      const __m128i lane = _mm_setr_epi32(0, 1, 2, 3);
+      const __m128i rv = _mm_set1_epi32(span.blend.l_r);
+      const __m128i gv = _mm_set1_epi32(span.blend.l_g);
+      const __m128i bv = _mm_set1_epi32(span.blend.l_b);
+      const __m128i fogv = _mm_set1_epi32((int)span.blend.fogadd);
+
+      // Lane i starts i steps in. The fractions wrap the same way the plain drawer's do.
+      __m128i xfv = _mm_add_epi32(_mm_set1_epi32((int)xf), _mm_mullo_epi32(lane, _mm_set1_epi32(span.xstep)));
+      __m128i yfv = _mm_add_epi32(_mm_set1_epi32((int)yf), _mm_mullo_epi32(lane, _mm_set1_epi32(span.ystep)));
+      const __m128i xsv = _mm_set1_epi32((int)(xs * 4));
+      const __m128i ysv = _mm_set1_epi32((int)(ys * 4));
+
+      Uint32 *d = dest + head;
+
+      for(int i = 0; i < body; i += 4, d += 4)
+      {
+         alignas(16) int index[4];
+
+         _mm_store_si128((__m128i *)index, _mm_add_epi32(
+            _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(xfv, 16), texmask), 6),
+            _mm_and_si128(_mm_srli_epi32(yfv, 16), texmask)));
+
+         __m128i texl = _mm_setr_epi32(source[index[0]], source[index[1]], source[index[2]], source[index[3]]);
+
+         __m128i blue = _mm_mullo_epi32(_mm_and_si128(texl, bluemask), bv);
+         __m128i green = _mm_and_si128(_mm_mullo_epi32(_mm_and_si128(texl, greenmask), gv), greenbits);
+         __m128i red = _mm_and_si128(_mm_mullo_epi32(texl, rv), redbits);
+         __m128i pixel = _mm_or_si128(_mm_or_si128(blue, green), red);
+
+         _mm_store_si128((__m128i *)d, _mm_add_epi32(_mm_srli_epi32(pixel, 8), fogv));
+
+         xfv = _mm_add_epi32(xfv, xsv);
+         yfv = _mm_add_epi32(yfv, ysv);
+      }
+
+      xf += body * xs;
+      yf += body * ys;
+   }
+
+   if(head + body < count)
+   {
+      renderspan_t part = span;
+
+      part.x1 = span.x1 + head + body;
+      part.xfrac = (int)xf;
+      part.yfrac = (int)yf;
+      drawSpan(part);
+   }
+}
+
+
+// Draws the sloped span 16 pixel segment by segment like the plain drawer, but works out the
+// ends of 4 segments with one divide and draws each segment 4 pixels at a time. The points
+// are stepped one after another first, the same way the plain drawer steps them, so u and v
+// come out exactly the same. Whatever is left after the last whole segment goes to the plain
+// drawer.
+void drawSlopedSpanSSE41(rslopespan_t slopespan)
+{
+   int count, segments;
+
+   if((count = slopespan.x2 - slopespan.x1 + 1) < 16)
+   {
+      drawSlopedSpan(slopespan);
+      return;
+   }
+
+   float iu = slopespan.iufrac, iv = slopespan.ivfrac, id = slopespan.idfrac;
+   float ius = slopespan.iustep, ivs = slopespan.ivstep, ids = slopespan.idstep;
+
+   const __m128i lane = _mm_setr_epi32(0, 1, 2, 3);
+   const __m128i mask6 = _mm_set1_epi32(0x3F);
+   const __m128i maskv = _mm_set1_epi32(0xFC0);
+   const __m128i bluemask = _mm_set1_epi32(0xFF);
+   const __m128i greenmask = _mm_set1_epi32(0xFF00);
+   const __m128i greenbits = _mm_set1_epi32(0xFF0000);
+   const __m128i redbits = _mm_set1_epi32((int)0xFF000000);
+   const __m128 fracunit = _mm_set1_ps(65536.0f);
+   const __m128 interpstep = _mm_set1_ps(1.0f / 16.0f);
+
+   // The light is stepped per pixel the whole way across.
+   __m128i rv = _mm_add_epi32(_mm_set1_epi32(slopespan.rfrac), _mm_mullo_epi32(lane, _mm_set1_epi32(slopespan.rstep)));
+   __m128i gv = _mm_add_epi32(_mm_set1_epi32(slopespan.gfrac), _mm_mullo_epi32(lane, _mm_set1_epi32(slopespan.gstep)));
+   __m128i bv = _mm_add_epi32(_mm_set1_epi32(slopespan.bfrac), _mm_mullo_epi32(lane, _mm_set1_epi32(slopespan.bstep)));
+   const __m128i rs4 = _mm_set1_epi32((int)((unsigned)slopespan.rstep * 4));
+   const __m128i gs4 = _mm_set1_epi32((int)((unsigned)slopespan.gstep * 4));
+   const __m128i bs4 = _mm_set1_epi32((int)((unsigned)slopespan.bstep * 4));
+
+   const Uint32 *src = (const Uint32 *)slopespan.src;
+   Uint32 *dest = (Uint32 *)slopespan.dest + (slopespan.y * slopespan.pitch) + slopespan.x1;
+
+   for(segments = count >> 4; segments > 0; )
+   {
+      int n = segments < 4 ? segments : 4;
+      alignas(16) float ds[8], us[8], vs[8];
+      alignas(16) int ufrac[4], ustep[4], vfrac[4], vstep[4];
+
+      for(int i = 0; i <= n; i++)
+      {
+         ds[i] = id;
+         us[i] = iu;
+         vs[i] = iv;
+
+         if(i < n)
+         {
+            id += ids * 16;
+            iu += ius * 16;
+            iv += ivs * 16;
+         }
+      }
+      for(int i = n + 1; i < 8; i++)
+      {
+         ds[i] = 1.0f;
+         us[i] = vs[i] = 0.0f;
+      }
+
+      __m128 mulstart = _mm_div_ps(fracunit, _mm_load_ps(ds));
+      __m128 mulend = _mm_div_ps(fracunit, _mm_loadu_ps(ds + 1));
+      __m128 ustart = _mm_mul_ps(_mm_load_ps(us), mulstart);
+      __m128 uend = _mm_mul_ps(_mm_loadu_ps(us + 1), mulend);
+      __m128 vstart = _mm_mul_ps(_mm_load_ps(vs), mulstart);
+      __m128 vend = _mm_mul_ps(_mm_loadu_ps(vs + 1), mulend);
+
+      _mm_store_si128((__m128i *)ufrac, _mm_cvttps_epi32(ustart));
+      _mm_store_si128((__m128i *)vfrac, _mm_cvttps_epi32(vstart));
+      _mm_store_si128((__m128i *)ustep, _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(uend, ustart), interpstep)));
+      _mm_store_si128((__m128i *)vstep, _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(vend, vstart), interpstep)));
+
+      for(int s = 0; s < n; s++)
+      {
+         __m128i uv = _mm_add_epi32(_mm_set1_epi32(ufrac[s]), _mm_mullo_epi32(lane, _mm_set1_epi32(ustep[s])));
+         __m128i vv = _mm_add_epi32(_mm_set1_epi32(vfrac[s]), _mm_mullo_epi32(lane, _mm_set1_epi32(vstep[s])));
+         const __m128i us4 = _mm_set1_epi32((int)((unsigned)ustep[s] * 4));
+         const __m128i vs4 = _mm_set1_epi32((int)((unsigned)vstep[s] * 4));
+
+         for(int quarter = 0; quarter < 4; quarter++, dest += 4)
+         {
+            alignas(16) int index[4];
+
+            _mm_store_si128((__m128i *)index, _mm_add_epi32(
+               _mm_and_si128(_mm_srai_epi32(vv, 10), maskv),
+               _mm_and_si128(_mm_srai_epi32(uv, 16), mask6)));
+
+            __m128i texl = _mm_setr_epi32(src[index[0]], src[index[1]], src[index[2]], src[index[3]]);
+
+            __m128i blue = _mm_mullo_epi32(_mm_and_si128(texl, bluemask), _mm_srai_epi32(bv, 16));
+            __m128i green = _mm_and_si128(_mm_mullo_epi32(_mm_and_si128(texl, greenmask), _mm_srai_epi32(gv, 16)), greenbits);
+            __m128i red = _mm_and_si128(_mm_mullo_epi32(texl, _mm_srai_epi32(rv, 16)), redbits);
+            __m128i pixel = _mm_or_si128(_mm_or_si128(blue, green), red);
+
+            _mm_storeu_si128((__m128i *)dest, _mm_srli_epi32(pixel, 8));
+
+            uv = _mm_add_epi32(uv, us4);
+            vv = _mm_add_epi32(vv, vs4);
+            rv = _mm_add_epi32(rv, rs4);
+            gv = _mm_add_epi32(gv, gs4);
+            bv = _mm_add_epi32(bv, bs4);
+         }
+      }
+
+      segments -= n;
+   }
+
+   if(count & 15)
+   {
+      slopespan.x1 += count & ~15;
+      slopespan.iufrac = iu;
+      slopespan.ivfrac = iv;
+      slopespan.idfrac = id;
+      slopespan.rfrac = _mm_cvtsi128_si32(rv);
+      slopespan.gfrac = _mm_cvtsi128_si32(gv);
+      slopespan.bfrac = _mm_cvtsi128_si32(bv);
+      drawSlopedSpan(slopespan);
+   }
+}
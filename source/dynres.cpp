@@ -0,0 +1,83 @@
+//
+// Copyright(C) 2007-2017 Stephen McGranahan
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/
+//
+// Purpose: Dynamic resolution controller
+// Authors: Stephen McGranahan
+//
+
+#include <math.h>
+#include "dynres.h"
+
+// The scale only moves in steps of this size, so it settles instead of hunting around.
+#define DYNRES_STEP (1.0f / 32.0f)
+
+// How far the frame time may drift from the target before the scale is changed. Dropping
+// the scale when frames run long is more urgent than raising it when they run short.
+#define DYNRES_OVER  1.05
+#define DYNRES_UNDER 0.85
+
+// The most the scale changes in one frame.
+#define DYNRES_MAXCHANGE 0.1f
+
+
+void initDynamicResolution(dynres_t &dr, double targetms, float minscale)
+{
+   dr.targetms = targetms;
+   dr.minscale = minscale;
+   dr.maxscale = 1.0f;
+   dr.scale = 1.0f;
+   dr.avgms = 0.0;
+}
+
+
+bool updateDynamicResolution(dynres_t &dr, double framems)
+{
+   float next;
+   double ratio;
+
+   if(dr.targetms <= 0.0 || framems <= 0.0)
+      return false;
+
+   dr.avgms = dr.avgms > 0.0 ? dr.avgms * 0.75 + framems * 0.25 : framems;
+
+   ratio = dr.avgms / dr.targetms;
+   if(ratio < DYNRES_OVER && ratio > DYNRES_UNDER)
+      return false;
+
+   // The frame time goes with the pixel count.
+   next = dr.scale / sqrtf((float)ratio);
+
+   if(next > dr.scale * (1.0f + DYNRES_MAXCHANGE))
+      next = dr.scale * (1.0f + DYNRES_MAXCHANGE);
+   else if(next < dr.scale * (1.0f - DYNRES_MAXCHANGE))
+      next = dr.scale * (1.0f - DYNRES_MAXCHANGE);
+
+   next = floorf(next / DYNRES_STEP + 0.5f) * DYNRES_STEP;
+
+   if(next > dr.maxscale)
+      next = dr.maxscale;
+   if(next < dr.minscale)
+      next = dr.minscale;
+
+   if(next == dr.scale)
+      return false;
+
+   // Guess what the frames will take at the new size, so the average doesn't make the
+   // controller overshoot while it catches up.
+   dr.avgms *= (next * next) / (dr.scale * dr.scale);
+   dr.scale = next;
+   return true;
+}
@@ -0,0 +1,45 @@
+//
+// Copyright(C) 2007-2017 Stephen McGranahan
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/
+//
+// Purpose: Dynamic resolution controller
+// Authors: Stephen McGranahan
+//
+
+#pragma once
+
+// -- Dynamic resolution --
+// Picks the scale a context renders at, relative to its target, to hold a frame time. The
+// scale is applied to both axes, so the pixel count (and roughly the frame time) goes with
+// the square of it. The rendered area is stretched to fill the window when presented.
+struct dynres_t
+{
+   // The render time to hold, in milliseconds. 0 turns the controller off.
+   double   targetms;
+
+   // Limits of the scale, 1 is the target's full size.
+   float    minscale, maxscale;
+
+   float    scale;
+
+   // Smoothed render time of the recent frames, 0 before the first frame.
+   double   avgms;
+};
+
+// Sets the controller up to hold targetms, starting at full size.
+void initDynamicResolution(dynres_t &dr, double targetms, float minscale);
+
+// Feeds in how long the last frame took to render. Returns true if the scale changed.
+bool updateDynamicResolution(dynres_t &dr, double framems);
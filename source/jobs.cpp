@@ -0,0 +1,229 @@
+//
+// Copyright(C) 2007-2017 Stephen McGranahan
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/
+//
+// Purpose: Work-stealing job pool
+// Authors: Stephen McGranahan
+//
+
+#include <SDL.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "error.h"
+#include "jobs.h"
+
+
+#define MAX_JOB_THREADS 64
+#define JOB_DEQUE_SIZE  1024
+
+struct job_t
+{
+   jobfunc_t   func;
+   void        *data;
+   jobgroup_t  *group;
+};
+
+// The owning thread pushes and pops at bottom, thieves take from top. Both only ever count
+// up and are wrapped when indexing.
+struct jobdeque_t
+{
+   std::mutex     lock;
+   unsigned int   top, bottom;
+   job_t          jobs[JOB_DEQUE_SIZE];
+};
+
+// Idle threads sleep on wake until there is something queued. Threads joining a group sleep
+// on it too, until something is queued or the group is done.
+struct jobsleep_t
+{
+   std::mutex              lock;
+   std::condition_variable wake;
+};
+
+static int        jobthreads = 1;
+static jobdeque_t *deques = NULL;
+static jobsleep_t *sleeping = NULL;
+
+// The number of jobs sitting in all of the deques.
+static std::atomic<int> queued(0);
+
+// The deque of the current thread. Threads outside of the pool use deque 0 along with the
+// thread that started the pool.
+static thread_local int jobindex = 0;
+
+
+static bool popJob(jobdeque_t &deque, job_t &job)
+{
+   std::lock_guard<std::mutex> lock(deque.lock);
+
+   if(deque.bottom == deque.top)
+      return false;
+
+   job = deque.jobs[--deque.bottom % JOB_DEQUE_SIZE];
+   return true;
+}
+
+
+static bool stealJob(jobdeque_t &deque, job_t &job)
+{
+   std::lock_guard<std::mutex> lock(deque.lock);
+
+   if(deque.bottom == deque.top)
+      return false;
+
+   job = deque.jobs[deque.top++ % JOB_DEQUE_SIZE];
+   return true;
+}
+
+
+static void runJob(job_t &job)
+{
+   job.func(job.data);
+
+   // The group may be gone as soon as pending reaches zero, so it can't be touched after.
+   if(job.group->pending.fetch_sub(1) == 1 && sleeping)
+   {
+      { std::lock_guard<std::mutex> lock(sleeping->lock); }
+      sleeping->wake.notify_all();
+   }
+}
+
+
+// Runs one job from this thread's deque, or stolen from another thread's. Returns false if
+// there was nothing to run.
+static bool runQueuedJob(void)
+{
+   job_t job;
+   bool found;
+
+   if(!queued.load())
+      return false;
+
+   found = popJob(deques[jobindex], job);
+
+   for(int i = 1; !found && i < jobthreads; i++)
+      found = stealJob(deques[(jobindex + i) % jobthreads], job);
+
+   if(!found)
+      return false;
+
+   queued--;
+   runJob(job);
+   return true;
+}
+
+
+static void jobThread(int index)
+{
+   jobindex = index;
+
+   for(;;)
+   {
+      if(runQueuedJob())
+         continue;
+
+      std::unique_lock<std::mutex> lock(sleeping->lock);
+      while(!queued.load())
+         sleeping->wake.wait(lock);
+   }
+}
+
+
+void initJobs(int threads)
+{
+   if(deques)
+      fatalError::Throw("initJobs: the job pool is already running");
+
+   if(threads <= 0)
+      threads = SDL_GetCPUCount();
+   if(threads > MAX_JOB_THREADS)
+      threads = MAX_JOB_THREADS;
+   if(threads < 1)
+      threads = 1;
+
+   // These are never freed, the threads are still waiting on them at exit.
+   deques = new jobdeque_t[threads];
+   sleeping = new jobsleep_t;
+   for(int i = 0; i < threads; i++)
+      deques[i].top = deques[i].bottom = 0;
+
+   jobthreads = threads;
+   jobindex = 0;
+
+   for(int i = 1; i < threads; i++)
+      std::thread(jobThread, i).detach();
+}
+
+
+int getJobThreadCount(void)
+{
+   return jobthreads;
+}
+
+
+void forkJob(jobgroup_t &group, jobfunc_t func, void *data)
+{
+   job_t job = {func, data, &group};
+
+   group.pending++;
+
+   if(jobthreads > 1)
+   {
+      jobdeque_t &deque = deques[jobindex];
+      bool pushed = false;
+
+      // Counted before it is pushed so a thief can never take the count below zero.
+      queued++;
+
+      {
+         std::lock_guard<std::mutex> lock(deque.lock);
+
+         if(deque.bottom - deque.top < JOB_DEQUE_SIZE)
+         {
+            deque.jobs[deque.bottom++ % JOB_DEQUE_SIZE] = job;
+            pushed = true;
+         }
+      }
+
+      if(pushed)
+      {
+         // Taking the lock makes sure a thread that just saw an empty pool is already
+         // waiting before it is woken.
+         { std::lock_guard<std::mutex> lock(sleeping->lock); }
+         sleeping->wake.notify_one();
+         return;
+      }
+
+      queued--;
+   }
+
+   runJob(job);
+}
+
+
+void joinJobs(jobgroup_t &group)
+{
+   while(group.pending.load())
+   {
+      if(runQueuedJob())
+         continue;
+
+      // Nothing left to steal, so the rest of the group is running on other threads.
+      std::unique_lock<std::mutex> lock(sleeping->lock);
+      while(group.pending.load() && !queued.load())
+         sleeping->wake.wait(lock);
+   }
+}
@@ -0,0 +1,55 @@
+//
+// Copyright(C) 2007-2017 Stephen McGranahan
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/
+//
+// Purpose: Work-stealing job pool
+// Authors: Stephen McGranahan
+//
+
+#pragma once
+
+#include <atomic>
+
+// -- Jobs --
+// There is one pool of job threads for the whole program. Every thread in the pool has its
+// own deque of jobs: new jobs are pushed onto the bottom of the forking thread's deque and
+// popped back off the bottom by the same thread, while idle threads steal from the top of
+// the other threads' deques.
+typedef void (*jobfunc_t)(void *data);
+
+// Jobs are forked into a group and joining the group waits for all of them to finish. A
+// joining thread runs queued jobs (from any group) while there are any, so jobs can fork
+// and join jobs of their own, and only sleeps once the rest of the group is running on
+// other threads.
+struct jobgroup_t
+{
+   std::atomic<int> pending;
+
+   jobgroup_t() : pending(0) {}
+};
+
+// Starts the pool. threads is the total number of threads that run jobs, including the
+// calling thread, so 1 runs everything inline. 0 uses one thread per core. Until this is
+// called every job is run inline by forkJob.
+void initJobs(int threads);
+
+// The number of threads that run jobs, including the thread that called initJobs.
+int getJobThreadCount(void);
+
+// Queues a job. If the pool isn't running, or the deque is full, the job is run right away.
+void forkJob(jobgroup_t &group, jobfunc_t func, void *data);
+
+// Returns once every job forked into group has finished.
+void joinJobs(jobgroup_t &group);
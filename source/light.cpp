@@ -0,0 +1,127 @@
+//
+// Copyright(C) 2007-2017 Stephen McGranahan
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/
+//
+// Purpose: Light table
+// Authors: Stephen McGranahan
+//
+
+#include <SDL.h>
+#include <math.h>
+#include <stdlib.h>
+#include "error.h"
+#include "light.h"
+#include "draw32.h"
+
+
+static light_t *lighttable = NULL;
+static Uint32  lightcount = 0, lightmax = 0;
+
+lightcache_t   *lightcaches = NULL;
+
+// calcLight adds a light level for every 1 / 10240 of distance.
+#define LIGHT_LEVELSCALE (2560.0f * 4)
+
+// Fog can ask for finer steps over a longer range than the light does. Past this many
+// blends the steps are made coarser instead.
+#define LIGHT_CACHE_MAX 4096
+
+
+// Compares field by field, memcmp would also compare the padding.
+static bool sameLight(const light_t &a, const light_t &b)
+{
+   return a.l_level == b.l_level && a.l_r == b.l_r && a.l_g == b.l_g && a.l_b == b.l_b &&
+          a.f_start == b.f_start && a.f_stop == b.f_stop &&
+          a.f_r == b.f_r && a.f_g == b.f_g && a.f_b == b.f_b;
+}
+
+
+// Each blend is worked out in the middle of its step, so a light level that starts at the
+// top of a step is never rounded down into the one before.
+static void buildLightCache(lightcache_t &cache, const light_t &light)
+{
+   float maxlight = light.l_level * 2 - 40, minlight = light.l_level * 2 - 224;
+   float scale = LIGHT_LEVELSCALE, end;
+
+   if(maxlight > 256)
+      maxlight = 256;
+
+   // Past where the light reaches maxlight only the fog can change it.
+   end = maxlight > 0 ? (maxlight - minlight) / LIGHT_LEVELSCALE : 0.0f;
+
+   // The fog goes up in 256 steps from f_stop to f_start.
+   if(light.f_start && light.f_start != light.f_stop)
+   {
+      float range = fabsf(light.f_start - light.f_stop);
+      float fogend = light.f_start > light.f_stop ? light.f_start : light.f_stop;
+
+      if(256.0f / range > scale)
+         scale = 256.0f / range;
+      if(fogend > end)
+         end = fogend;
+   }
+
+   if(end * scale + 2.0f > LIGHT_CACHE_MAX)
+      scale = (LIGHT_CACHE_MAX - 2) / end;
+
+   cache.count = (int)(end * scale) + 2;
+   cache.scale = scale;
+   cache.blends = (lightblend_t *)malloc(sizeof(lightblend_t) * cache.count);
+
+   if(!cache.blends)
+      fatalError::Throw("buildLightCache: out of memory");
+
+   for(int i = 0; i < cache.count; i++)
+      cache.blends[i] = calcLight((i + 0.5f) / scale, 0, light);
+}
+
+
+Uint32 internLight(const light_t &light)
+{
+   // There are only ever a handful of distinct lights in a map so a linear search is fine.
+   for(Uint32 i = 0; i < lightcount; i++)
+   {
+      if(sameLight(lighttable[i], light))
+         return i;
+   }
+
+   if(lightcount == lightmax)
+   {
+      Uint32 newmax = lightmax ? lightmax * 2 : 64;
+      light_t *newtable = (light_t *)realloc(lighttable, sizeof(light_t) * newmax);
+      lightcache_t *newcaches;
+
+      if(!newtable)
+         fatalError::Throw("internLight: out of memory");
+
+      lighttable = newtable;
+
+      if(!(newcaches = (lightcache_t *)realloc(lightcaches, sizeof(lightcache_t) * newmax)))
+         fatalError::Throw("internLight: out of memory");
+
+      lightcaches = newcaches;
+      lightmax = newmax;
+   }
+
+   lighttable[lightcount] = light;
+   buildLightCache(lightcaches[lightcount], light);
+   return lightcount++;
+}
+
+
+Uint32 getLightCount(void)
+{
+   return lightcount;
+}
@@ -47,3 +47,48 @@ struct light_t
    Uint8 f_r, f_g, f_b;
 };
 
+// What calcLight works a light out to for a given distance. The drawers multiply the pixel
+// channels by l_r, l_g and l_b and add fogadd.
+struct lightblend_t
+{
+	Uint16 l_r, l_g, l_b;
+	Uint32 fogadd;
+};
+
+
+// -- Light table --
+// Every distinct light_t in use is given a small id, so the renderer can compare lights with
+// a single integer compare. Lights are never removed from the table, so an id stays valid
+// for the life of the program.
+
+// Returns the id of the given light, adding it to the table if it is not there yet. Not
+// thread safe, this is meant to be called when the map data is set up or changed.
+Uint32 internLight(const light_t &light);
+
+// The number of distinct lights in the table. Ids run from 0 to getLightCount() - 1.
+Uint32 getLightCount(void);
+
+// -- Light cache --
+// calcLight for every light in the table, worked out by internLight when the light is added.
+// The blends are sampled at steps of 1 / scale in the distance calcLight takes (1 / depth),
+// so a light level step apart at most, and the last one is used for anything past the end.
+// A light never changes once it is in the table. When a sector's light changes it is
+// interned again, which builds a cache for the new light.
+struct lightcache_t
+{
+   lightblend_t *blends;
+   int          count;
+   float        scale;
+};
+
+extern lightcache_t *lightcaches;
+
+// Does what calcLight(distance, 0, light) does, for the light with the given id.
+inline const lightblend_t &getLightBlend(Uint32 lightid, float distance)
+{
+   const lightcache_t &cache = lightcaches[lightid];
+   float f = distance * cache.scale;
+   int last = cache.count - 1;
+
+   return cache.blends[f > 0.0f ? (f < (float)last ? (int)f : last) : 0];
+}
@@ -22,8 +22,16 @@
 // Cardboard - an experiment in doom-style projection and texture mapping
 //
 #include <SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "render.h"
 #include "mapdata.h"
+#include "bsp.h"
+#include "transform.h"
+#include "jobs.h"
+#include "timedemo.h"
+#include "trace.h"
 
 vidDriver *screen;
 
@@ -39,15 +47,106 @@ int main (int argc, char **argv)
    int result;
    float fps[30], total;
    int   index = -1, i;
+   int   jobthreads = 0, pages = 1;
+   int   width = 1920, height = 1080;
+   double dynresms = 0.0;
+   bool  headless = false, timedemo = false, showstats = false, directpresent = false;
+   bool  lowdetail = false;
+   const char *demofile = NULL;
+
+   for(i = 1; i < argc; i++)
+   {
+      // -strips <n>: split the screen into n strips rendered in parallel.
+      if(!strcmp(argv[i], "-strips") && i + 1 < argc)
+         renderstrips = atoi(argv[++i]);
+      // -threads <n>: run jobs on n threads, 0 (the default) uses one per core.
+      else if(!strcmp(argv[i], "-threads") && i + 1 < argc)
+         jobthreads = atoi(argv[++i]);
+      // -width <n> / -height <n>: the size of the window, or the headless surface.
+      else if(!strcmp(argv[i], "-width") && i + 1 < argc)
+         width = atoi(argv[++i]);
+      else if(!strcmp(argv[i], "-height") && i + 1 < argc)
+         height = atoi(argv[++i]);
+      // -dynres <ms>: lower the render resolution when frames take longer than ms to render,
+      // and raise it again when they are quicker.
+      else if(!strcmp(argv[i], "-dynres") && i + 1 < argc)
+         dynresms = atof(argv[++i]);
+      // -lowdetail: start with walls and flats at half horizontal resolution. L toggles it.
+      else if(!strcmp(argv[i], "-lowdetail"))
+         lowdetail = true;
+      // -simd <none|sse4.1|avx2>: use at most the given instruction set in the drawers. The
+      // best one the CPU has is used by default.
+      else if(!strcmp(argv[i], "-simd") && i + 1 < argc)
+      {
+         int level;
+
+         for(level = SIMD_NONE; level < NUMSIMDLEVELS; level++)
+         {
+            if(!strcmp(argv[i + 1], getSIMDLevelName(level)))
+               break;
+         }
+
+         if(level == NUMSIMDLEVELS)
+         {
+            fprintf(stderr, "Unknown SIMD level %s\n", argv[i + 1]);
+            return 1;
+         }
+
+         setSIMDLevel(level);
+         i++;
+      }
+      // -headless: render into a surface in memory with no window. Implies -timedemo.
+      else if(!strcmp(argv[i], "-headless"))
+         headless = timedemo = true;
+      // -directpresent: render straight into the window texture instead of into a surface in
+      // memory that is copied to it every frame. The renderer does not draw every pixel of
+      // every frame (unreached sectors in portal mode, skipped planes, the last column at low
+      // detail), and those are left with whatever the texture held, so this is opt-in.
+      else if(!strcmp(argv[i], "-directpresent"))
+         directpresent = true;
+      // -pages <n>: flip between n screen pages (up to 3). With 2 or more, the next frame is
+      // rendered while the last one is presented.
+      else if(!strcmp(argv[i], "-pages") && i + 1 < argc)
+         pages = atoi(argv[++i]);
+      // -timedemo: play the built in camera path as fast as possible and print frame times.
+      else if(!strcmp(argv[i], "-timedemo"))
+         timedemo = true;
+      // -stats: time the render phases and show them in the window title.
+      else if(!strcmp(argv[i], "-stats"))
+         showstats = statsenabled = true;
+      // -trace <file>: record a Chrome trace of the renderer and write it on exit.
+      else if(!strcmp(argv[i], "-trace") && i + 1 < argc)
+         startTrace(argv[++i]);
+      // -statscsv <file>: write the render stats of every frame to a CSV file.
+      else if(!strcmp(argv[i], "-statscsv") && i + 1 < argc)
+      {
+         if(!openStatsFile(argv[++i]))
+         {
+            fprintf(stderr, "Could not open %s\n", argv[i]);
+            return 1;
+         }
+      }
+      // -demofile <file>: like -timedemo, but with the camera path read from a file.
+      else if(!strcmp(argv[i], "-demofile") && i + 1 < argc)
+      {
+         demofile = argv[++i];
+         timedemo = true;
+      }
+   }
+
+   initJobs(jobthreads);
 
    SDL_setenv("SDL_VIDEO_WINDOW_POS", "center", true);
    SDL_setenv("SDL_VIDEO_CENTERED", "1", true);
-   result = SDL_Init(SDL_INIT_TIMER|SDL_INIT_VIDEO);
+   result = SDL_Init(headless ? SDL_INIT_TIMER : SDL_INIT_TIMER|SDL_INIT_VIDEO);
 
    if(result == -1)
       return -1;
 
-   screen = vidDriver::setVideoMode(1920, 1080, 32, 0);
+   if(headless)
+      screen = new vidDriver(width, height, 32);
+   else
+      screen = vidDriver::setVideoMode(width, height, 32, 0, directpresent, pages);
    
    SDL_Event e;
    bool update = true, up = false, down = false;
@@ -55,14 +154,35 @@ int main (int argc, char **argv)
    bool deletekey = false, endkey = false;
 
    hackMapData();
+   buildNodes();
+   initVertexBuffer();
    loadTextures();
 
-   moveCamera(-192.0f);
-   //rotateCamera(3.14f * 0.5f);
-   //moveCamera(-64.0f);
-   flyCamera(-39.0f);
+   rendercontext_t *mainview = new rendercontext_t();
+   camera_t &camera = mainview->camera;
+
+   moveCamera(camera, -192.0f);
+   //rotateCamera(camera, 3.14f * 0.5f);
+   //moveCamera(camera, -64.0f);
+   flyCamera(camera, -39.0f);
 
-   initRenderer();
+   initRenderer(*mainview, screen);
+   initDynamicResolution(mainview->dynres, dynresms, 0.25f);
+   if(lowdetail)
+      setDetailShift(*mainview, 1);
+
+   if(timedemo)
+   {
+      timedemo_t demo = getDefaultTimedemo();
+
+      if(demofile && !loadTimedemo(demofile, demo))
+      {
+         fprintf(stderr, "Could not load timedemo %s\n", demofile);
+         return 1;
+      }
+
+      return runTimedemo(*mainview, demo) ? 0 : 1;
+   }
 
    while(1)
    {
@@ -103,6 +223,14 @@ int main (int argc, char **argv)
                   endkey = true;
                   break;
 
+               case SDL_SCANCODE_P:
+                  portalrender = !portalrender;
+                  break;
+
+               case SDL_SCANCODE_L:
+                  setDetailShift(*mainview, !mainview->view.detailshift);
+                  break;
+
                case SDL_SCANCODE_ESCAPE:
                   return 0;
                   break;
@@ -153,48 +281,50 @@ int main (int argc, char **argv)
 
       if(up)
       {
-         moveCamera(0.2f * movetics);
+         moveCamera(camera, 0.2f * movetics);
          update = true;
       }
       if(down)
       {
-         moveCamera(-0.2f * movetics);
+         moveCamera(camera, -0.2f * movetics);
          update = true;
       }
       if(left)
       {
-         rotateCamera(-.002f * movetics);
+         rotateCamera(camera, -.002f * movetics);
          update = true;
       }
       if(right)
       {
-         rotateCamera(.002f * movetics);
+         rotateCamera(camera, .002f * movetics);
          update = true;
       }
       if(pgup)
       {
-         flyCamera(0.1f * movetics);
+         flyCamera(camera, 0.1f * movetics);
          update = true;
       }
       if(pgdn)
       {
-         flyCamera(-0.1f * movetics);
+         flyCamera(camera, -0.1f * movetics);
          update = true;
       }
       if(deletekey)
       {
-         strafeCamera(-0.1f * movetics);
+         strafeCamera(camera, -0.1f * movetics);
          update = true;
       }
       if(endkey)
       {
-         strafeCamera(0.1f * movetics);
+         strafeCamera(camera, 0.1f * movetics);
          update = true;
       }
 
 
       Uint32 ticks = SDL_GetTicks();
-      renderScene();
+      renderFrame(*mainview);
+      writeStatsFile(frameid, mainview->stats);
+      nextFrameID();
       ticks = SDL_GetTicks() - ticks;
 
       if(index == -1)
@@ -222,6 +352,21 @@ int main (int argc, char **argv)
          else
             sprintf(title, "cardboard 0.0.2 by Stephen McGranahan (%i fps)", (int)(total / 30.0f));
 
+         if(mainview->dynres.targetms > 0.0)
+         {
+            size_t len = strlen(title);
+
+            snprintf(title + len, sizeof(title) - len, " - %ix%i", mainview->view.screenwidth, mainview->view.height);
+         }
+
+         if(showstats)
+         {
+            size_t len = strlen(title);
+
+            snprintf(title + len, sizeof(title) - len, " - ");
+            formatStats(mainview->stats, title + len + 3, sizeof(title) - len - 3);
+         }
+
          vidDriver::updateWindowTitle(title);
       }
 
@@ -65,6 +65,8 @@ mapsector_t sectorlist[] = {
 {-80.0f, 64.0f, 0, 0, 0, 0, {128, 256, 256, 256, 0, 0, 90, 0, 0}, 0, NULL, &slopes[0], &slopes[1]},
 {-48.0f, 32.0f, 0, 0, 0, 0, {128, 256, 256, 256, 0, 0, 90, 0, 0}, 0, NULL, NULL, NULL}};
 
+Uint32   slopecount = 0;
+
 
 
 frameid_t    frameid = 0;
@@ -73,14 +75,6 @@ frameid_t    frameid = 0;
 void nextFrameID(void)
 {
    frameid++;
-
-   if(!frameid)
-   {
-      frameid = 1;
-
-      for(unsigned i = 0; i < vertexcount; i++)
-         vertexlist[i].frameid = 0;
-   }
 }
 
 
@@ -98,11 +92,41 @@ float zPositionAt(pslope_t *slope, float x, float y)
 
 
 
+mapsector_t *sectorAtPoint(float x, float y)
+{
+   for(Uint32 i = 0; i < sectorcount; i++)
+   {
+      mapsector_t *sector = sectorlist + i;
+      bool inside = false;
+
+      // Count how many of the sector's lines a ray cast in the +x direction crosses.
+      for(Uint32 l = 0; l < sector->linecount; l++)
+      {
+         mapvertex_t *v1 = sector->lines[l]->v1, *v2 = sector->lines[l]->v2;
+
+         if((v1->y > y) != (v2->y > y) &&
+            x < v1->x + (y - v1->y) * (v2->x - v1->x) / (v2->y - v1->y))
+            inside = !inside;
+      }
+
+      if(inside)
+         return sector;
+   }
+
+   return NULL;
+}
+
+
+
+#define DOOMFLATORI
+
 void makeSlopePlane(pslope_t *slope, bool isceiling)
 {
    vector3f  v1, v2, v3, p;
+   int x, y;
 
    slope->isceiling = isceiling;
+   slope->id = slopecount++;
 
    v1.x = slope->xori;
    v1.y = slope->yori;
@@ -133,6 +157,39 @@ void makeSlopePlane(pslope_t *slope, bool isceiling)
    p.normalize();
 
    slope->slope = p.z;
+
+   x = (int)slope->xori;
+   y = (int)slope->yori;
+
+   // TODO: replace 64 with actual texture width.
+   x -= x % 64;
+   y -= y % 64;
+
+   slope->texp.x = (float)x;
+   slope->texp.z = (float)(y - 64);
+   slope->texp.y = zPositionAt(slope, slope->texp.x, slope->texp.z);
+
+#ifdef DOOMFLATORI
+   // Should be texture width.. Also, todo: Rotation
+   slope->texm.x = slope->texp.x - 64.0f;
+   slope->texm.z = slope->texp.z;
+   slope->texm.y = zPositionAt(slope, slope->texm.x, slope->texm.z);
+
+   // Should be texture width.. Also, todo: Rotation
+   slope->texn.x = slope->texp.x;
+   slope->texn.z = slope->texp.z - 64.0f;
+   slope->texn.y = zPositionAt(slope, slope->texn.x, slope->texn.z);
+#else
+   // Should be texture width.. Also, todo: Rotation
+   slope->texm.x = slope->texp.x;
+   slope->texm.z = slope->texp.z + 64.0f;
+   slope->texm.y = zPositionAt(slope, slope->texm.x, slope->texm.z);
+
+   // Should be texture width.. Also, todo: Rotation
+   slope->texn.x = slope->texp.x + 64.0f;
+   slope->texn.z = slope->texp.z;
+   slope->texn.y = zPositionAt(slope, slope->texn.x, slope->texn.z);
+#endif
 }
 
 
@@ -140,9 +197,6 @@ void hackMapData(void)
 {
    Uint32 i, p;
 
-   for(i = 0; i < vertexcount; i++)
-      vertexlist[i].frameid = 0;
-
    for(i = 0; i < sidecount; i++)
       sidelist[i].sector = sectorlist + ((size_t)sidelist[i].sector - 1);
 
@@ -191,6 +245,8 @@ void hackMapData(void)
             sectorlist[i].lines[count++] = linelist + p;
       }
 
+      sectorlist[i].lightid = internLight(sectorlist[i].light);
+
       if(sectorlist[i].cslope)
          makeSlopePlane(sectorlist[i].cslope, true);
       if(sectorlist[i].fslope)
@@ -21,6 +21,7 @@
 #pragma once
 
 #include "light.h"
+#include "vectors.h"
 
 // ----- Map data -----
 using frameid_t = unsigned int;
@@ -29,17 +30,14 @@ extern frameid_t frameid;
 struct mapsector_t;
 
 // -- Map vertex --
-// The map vertices store the x and y (which translates to horizontal and distance in 3D)
-// as a speed booster, the projected x and distance are stored in each vertex from the frame currently being rendered
-// so each vertex only has to be projected once, except in cases where the vertex is clipped to the view plane, in which case
-// the projection values will not be stored.
+// The map vertices store the x and y (which translates to horizontal and distance in 3D).
+// Every vertex is transformed and projected once per frame by transformVertices, and the
+// results are stored in the vertex buffer at the vertex's index.
 struct mapvertex_t
 {
    float x, y;
 
-   frameid_t   frameid;
-   float proj_x, distance, idistance;
-   float t_x, t_y;
+   Uint32 index;
 };
 
 
@@ -67,8 +65,35 @@ struct mapline_t
 
 
 
+// -- Map seg --
+// A seg is the piece of a line that is actually projected by the renderer. Lines that cross
+// a BSP partition are split into several segs. The offset is the distance along the line
+// from line->v1 to the seg's v1 and is used to keep the texture aligned across the split.
+struct mapseg_t
+{
+   mapvertex_t    *v1, *v2;
+   float          offset, length;
+
+   mapline_t      *line;
+};
+
+
+
 // -- Map sector --
 
+// The texture vectors of a slope for the camera of the frame being rendered. Every render
+// context has its own, indexed by the id of the slope.
+struct sv_t
+{
+   // Magic vectors!
+   vector3f  a, b, c;
+
+   // The height of the plane under the camera.
+   float zat;
+
+   float plight;
+};
+
 // A planeslope equasion consists of a 2d vertex, 2d directional vector, and a 
 // unit slope  (that is, z delta per map unit traveled along the directional 
 // vector in 2d space), 
@@ -85,6 +110,13 @@ struct pslope_t
    float px, py, pz;
 
    bool  isceiling;
+
+   // The corners of the texture tile at the origin, in view space axes (y is up). They only
+   // depend on the slope, so makeSlopePlane sets them.
+   vector3f texp, texm, texn;
+
+   // The index of the slope in a context's slope vectors. Set by makeSlopePlane.
+   Uint32   id;
 };
 
 
@@ -102,6 +134,10 @@ struct mapsector_t
 
    // For slopes, a bit of extra data is needed.
    pslope_t  *fslope, *cslope;
+
+   // The id of light in the light table. Set by hackMapData, and has to be interned again
+   // whenever light changes.
+   Uint32 lightid;
 };
 
 
@@ -120,10 +156,15 @@ extern mapline_t linelist[];
 extern Uint32   sectorcount;
 extern mapsector_t sectorlist[];
 
+// The number of slopes makeSlopePlane has set up.
+extern Uint32   slopecount;
 
 
 float zPositionAt(pslope_t *slope, float x, float y);
 
+// Returns the sector containing the given point, or NULL if it is outside the map.
+mapsector_t *sectorAtPoint(float x, float y);
+
 
 void nextFrameID(void);
 void hackMapData(void);
@@ -19,6 +19,10 @@
 //
 
 #include <SDL.h>
+#include <atomic>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include "video.h"
 #include "matrix.h"
 #include "error.h"
@@ -28,12 +32,10 @@
 #include "mapdata.h"
 #include "visplane.h"
 #include "vectors.h"
-
-
-// -- Camera --
-
-camera_t camera;
-viewport_t view;
+#include "bsp.h"
+#include "transform.h"
+#include "jobs.h"
+#include "trace.h"
 
 
 // -- Rendering --
@@ -45,10 +47,48 @@ vidDriver *texture = NULL;
 
 
 
-// -- Clipping --
-// Much like in doom. The screen clipping array starts out open and closes up as walls
-// are rendered.
-float    cliptop[MAX_WIDTH], clipbot[MAX_WIDTH];
+// -- Solid segs --
+// Sorted list of the column ranges that are fully closed, like doom's solidsegs. Walls
+// are checked against it right after their x range is projected so hidden walls are
+// dropped before any of the height setup, and partly hidden walls are only rasterized
+// in the open gaps. The first and last entries are sentinels that extend off the strip
+// being rendered.
+struct cliprange_t
+{
+   int x1, x2;
+};
+
+// Ideally, this would be the number of pixels that fit on a cache line.
+#define COLUMN_CHUNK_WIDTH 16
+
+
+// -- Strips --
+// The part of a render context that belongs to one vertical strip of the screen.
+struct renderstrip_t
+{
+   rendercontext_t   *ctx;
+   wallrange_t       window;
+
+   cliprange_t       *solidsegs, *solidsegsend;
+
+   // Open column ranges of the wall currently being projected.
+   wallrange_t       *openranges;
+
+   // Both range arrays have room for maxranges entries, enough for a window half again as
+   // wide as maxranges. They share rangeblock.
+   int               maxranges;
+   void              *rangeblock;
+
+   // Column chunks for renderWall1s and renderWall2s, which batches the lower parts of
+   // two-sided walls separately.
+   rendercolumn_t    columns[COLUMN_CHUNK_WIDTH], lowercolumns[COLUMN_CHUNK_WIDTH];
+
+   planepool_t       planes;
+
+   renderstats_t     stats;
+};
+
+#define MAX_RENDERSTRIPS 64
 
 
 
@@ -59,6 +99,9 @@ void loadTextures(void)
       exit(0);
 
    texture->convertFormat(*screen);
+
+   // Every render context reads the texture at once, so it is left locked for good.
+   texture->lock();
 }
 
 
@@ -83,34 +126,295 @@ void wrapAngle(float *ang)
 }
 
 
-void initRenderer(void)
+void *allocCacheAligned(void *&block, size_t size)
 {
+   free(block);
+   block = malloc(size + CACHE_LINE_SIZE - 1);
+   if(!block)
+      fatalError::Throw("allocCacheAligned: out of memory");
+
+   return (void *)(((uintptr_t)block + CACHE_LINE_SIZE - 1) & ~(uintptr_t)(CACHE_LINE_SIZE - 1));
+}
+
+
+
+// Sets up the projection for a view of width x height pixels. Everything is drawn at the
+// top left of the target, so the pitch stays the target's.
+static void setupViewport(rendercontext_t &ctx, int width, int height)
+{
+   viewport_t &view = ctx.view;
    float fov = 90.0f, ratio, slopet;
 
-   view.xcenter = screen->getWidth() / 2.0f;
-   view.ycenter = screen->getHeight() / 2.0f;
+   if(width < 2)
+      view.detailshift = 0;
 
-   view.width = screen->getWidth();
-   view.height = screen->getHeight();
+   view.width = width >> view.detailshift;
+   view.height = height;
+   view.screenwidth = width;
+   view.pitch = ctx.target->getPitch() / 4;
+
+   view.xcenter = view.width / 2.0f;
+   view.ycenter = height / 2.0f;
 
    view.fov = fov;
    fov = fov * pi / 180.0f;
    view.tan = (float)tan(fov/2.0f);
 
-   ratio = 1.6f / ((float)view.width / (float)view.height);
+   // The vertical projection is the same at either detail level, only the columns are
+   // wider.
+   ratio = 1.6f / ((float)width / (float)view.height);
    view.xfoc = view.xcenter / view.tan;
-   view.yfoc = view.xfoc * ratio;
+   view.yfoc = (width / 2.0f) / view.tan * ratio;
    view.focratio = view.yfoc / view.xfoc;
 
    // Thanks to 'Randi' of Zdoom fame!
    slopet = tan((90.0f + view.fov / 2.0f) * pi / 180.0f);
-   sv.vis = 8.0f * slopet * 16.0f * 320.0f / (float)view.width;
+   view.slopevis = 8.0f * slopet * 16.0f * 320.0f / (float)view.width;
+
+   view.chunkfunc = getChunkDrawer(view.detailshift);
+   view.spanfunc = getSpanDrawer(view.detailshift);
+   view.slopespanfunc = getSlopedSpanDrawer(view.detailshift);
+   view.colfunc = view.detailshift ? drawColumnLow : drawColumn;
+
+   // renderSpan's distance to each row. .01 is used for the center row so there is no
+   // divide by 0.
+   for(int y = 0; y < height; y++)
+   {
+      float dy;
+
+      if(view.ycenter == y)
+         dy = 0.01f;
+      else if(y < view.ycenter)
+         dy = fabsf(view.ycenter - y) - 1.0f;
+      else
+         dy = fabsf(view.ycenter - y) + 1.0f;
+
+      ctx.rowidy[y] = 1.0f / fabsf(dy);
+   }
+
+   ctx.target->setViewSize(view.width << view.detailshift, height);
+}
+
+
+
+void setRenderScale(rendercontext_t &ctx, float scale)
+{
+   int width = (int)(ctx.target->getWidth() * scale + 0.5f);
+   int height = (int)(ctx.target->getHeight() * scale + 0.5f);
+
+   if(width < 1)
+      width = 1;
+   else if(width > (int)ctx.target->getWidth())
+      width = ctx.target->getWidth();
+   if(height < 1)
+      height = 1;
+   else if(height > (int)ctx.target->getHeight())
+      height = ctx.target->getHeight();
+
+   if(width != ctx.view.screenwidth || height != ctx.view.height)
+      setupViewport(ctx, width, height);
+}
+
+
+
+void setDetailShift(rendercontext_t &ctx, int detailshift)
+{
+   ctx.view.detailshift = detailshift ? 1 : 0;
+   setupViewport(ctx, ctx.view.screenwidth, ctx.view.height);
+}
+
+
+
+void initRenderer(rendercontext_t &ctx, vidDriver *target)
+{
+   viewport_t &view = ctx.view;
+
+   ctx.target = target;
+
+   ctx.rowblock = NULL;
+   ctx.rowidy = (float *)allocCacheAligned(ctx.rowblock, sizeof(float) * target->getHeight());
+
+   ctx.slopeblock = NULL;
+   ctx.slopevectors = (sv_t *)allocCacheAligned(ctx.slopeblock, sizeof(sv_t) * (slopecount ? slopecount : 1));
+
+   view.detailshift = 0;
+   setupViewport(ctx, target->getWidth(), target->getHeight());
+   initDynamicResolution(ctx.dynres, 0.0, 1.0f);
+
+   ctx.vertices.block = NULL;
+   initViewVertices(ctx.vertices);
+
+   // Both clip arrays in one block, each starting on its own cache line. They are sized for
+   // the whole target, a smaller render scale only uses part of them.
+   int clipwidth = (view.width + CACHE_LINE_SIZE / sizeof(float) - 1) & ~(int)(CACHE_LINE_SIZE / sizeof(float) - 1);
+
+   ctx.clipblock = NULL;
+   ctx.cliptop = (float *)allocCacheAligned(ctx.clipblock, sizeof(float) * clipwidth * 2);
+   ctx.clipbot = ctx.cliptop + clipwidth;
+
+   ctx.strips = new renderstrip_t[MAX_RENDERSTRIPS]();
+   ctx.numstrips = MAX_RENDERSTRIPS;
+
+   for(int i = 0; i < ctx.numstrips; i++)
+      ctx.strips[i].ctx = &ctx;
+}
+
+
+
+// Makes sure the strip's range arrays can hold every range its window can be split into,
+// which is at most one for every other column plus the sentinels.
+static void reserveStripRanges(renderstrip_t &rs)
+{
+   int needed = (rs.window.x2 - rs.window.x1 + 1) / 2 + 4;
+   cliprange_t *ranges;
+
+   if(needed <= rs.maxranges)
+      return;
+
+   ranges = (cliprange_t *)allocCacheAligned(rs.rangeblock, (sizeof(cliprange_t) + sizeof(wallrange_t)) * needed);
+
+   rs.solidsegs = ranges;
+   rs.openranges = (wallrange_t *)(ranges + needed);
+   rs.maxranges = needed;
+}
+
+
+
+// Opens the columns x1 through x2 and closes everything else.
+void clearSolidSegs(renderstrip_t &rs, int x1, int x2)
+{
+   cliprange_t *solidsegs = rs.solidsegs;
+
+   solidsegs[0].x1 = INT_MIN;
+   solidsegs[0].x2 = x1 - 1;
+   solidsegs[1].x1 = x2 + 1;
+   solidsegs[1].x2 = INT_MAX;
+   rs.solidsegsend = solidsegs + 2;
+}
+
+
+
+// Returns true once every column of the strip is closed, which is when everything has been
+// merged into a single range.
+bool screenClosed(renderstrip_t &rs)
+{
+   return rs.solidsegsend - rs.solidsegs == 1;
+}
+
+
+
+// Marks the columns x1 through x2 as closed, merging with any touching ranges.
+void addSolidSeg(renderstrip_t &rs, int x1, int x2)
+{
+   cliprange_t *solidsegs = rs.solidsegs, *&solidsegsend = rs.solidsegsend;
+   cliprange_t *start = solidsegs, *next;
+
+   // Find the first range that touches or comes after x1.
+   while(start->x2 < x1 - 1)
+      start++;
+
+   if(x1 < start->x1)
+   {
+      if(x2 < start->x1 - 1)
+      {
+         // Doesn't touch anything, so insert a new range before start.
+         memmove(start + 1, start, (solidsegsend - start) * sizeof(cliprange_t));
+         solidsegsend++;
+
+         start->x1 = x1;
+         start->x2 = x2;
+         return;
+      }
+
+      start->x1 = x1;
+   }
+
+   if(x2 <= start->x2)
+      return;
+
+   // Swallow every range the new one reaches.
+   next = start;
+   while(x2 >= (next + 1)->x1 - 1)
+   {
+      next++;
+      if(next->x2 >= x2)
+      {
+         x2 = next->x2;
+         break;
+      }
+   }
+
+   start->x2 = x2;
+
+   if(next != start)
+   {
+      memmove(start + 1, next + 1, (solidsegsend - (next + 1)) * sizeof(cliprange_t));
+      solidsegsend -= next - start;
+   }
 }
 
 
 
-void setupFrame(void)
+// Adds any closed columns between x1 and x2 to the solid segs. Two-sided walls can close
+// columns when the back sector has no opening.
+void addClosedColumns(renderstrip_t &rs, int x1, int x2)
 {
+   const float *cliptop = rs.ctx->cliptop, *clipbot = rs.ctx->clipbot;
+
+   for(int x = x1; x <= x2; x++)
+   {
+      if(cliptop[x] < clipbot[x])
+         continue;
+
+      int start = x;
+      while(x < x2 && cliptop[x + 1] >= clipbot[x + 1])
+         x++;
+
+      addSolidSeg(rs, start, x);
+   }
+}
+
+
+
+// Fills ranges with the open column ranges between x1 and x2 and returns how many there
+// are.
+int getOpenRanges(renderstrip_t &rs, int x1, int x2, wallrange_t *ranges)
+{
+   cliprange_t *r = rs.solidsegs;
+   int count = 0;
+
+   if(x1 > x2)
+      return 0;
+
+   while(r->x2 < x1)
+      r++;
+
+   for(;;)
+   {
+      if(r->x1 > x1)
+      {
+         ranges[count].x1 = x1;
+         ranges[count].x2 = r->x1 - 1 < x2 ? r->x1 - 1 : x2;
+         count++;
+      }
+
+      if(r->x2 >= x2)
+         break;
+
+      x1 = r->x2 + 1;
+      r++;
+   }
+
+   return count;
+}
+
+
+
+void setupFrame(rendercontext_t &ctx)
+{
+   camera_t &camera = ctx.camera;
+   viewport_t &view = ctx.view;
+
    camera.rotmat.setIdentity();
    camera.rotmat.rotateAngle(camera.angle);
 
@@ -124,15 +428,20 @@ void setupFrame(void)
    view.anglestep = (view.fov * pi) / (180.0f * view.width);
    view.leftangle = camera.angle - view.xcenter * view.anglestep;
 
+   static std::atomic<Uint32> planeframes(0);
+   ctx.planeframe = ++planeframes;
+
+   setupSlopes(ctx);
+
 
    // reset the clipping arrays
-   for(int i = 0; i < MAX_WIDTH; i++)
+   for(int i = 0; i < view.width; i++)
    {
-      cliptop[i] = 0.0f;
-      clipbot[i] = view.height - 1;
+      ctx.cliptop[i] = 0.0f;
+      ctx.clipbot[i] = view.height - 1;
    }
 
-   auto bytesPerPixel = screen->getFormat().BytesPerPixel;
+   auto bytesPerPixel = ctx.target->getFormat().BytesPerPixel;
    switch(bytesPerPixel)
    {
       case 4:
@@ -142,22 +451,23 @@ void setupFrame(void)
          break;
    }
 
+   // A screen that presents directly only knows its pitch once it is locked, and it can
+   // change from frame to frame.
+   view.pitch = ctx.target->getPitch() / 4;
 
-   unlinkPlanes();
-
-   nextFrameID();
+   transformVertices(ctx.vertices, camera, view);
 }
 
 
 
-void moveCamera(float speed)
+void moveCamera(camera_t &camera, float speed)
 {
    camera.x += sinf(camera.angle) * speed;
    camera.y += cosf(camera.angle) * speed;
 }
 
 
-void strafeCamera(float speed)
+void strafeCamera(camera_t &camera, float speed)
 {
    camera.x += cosf(camera.angle) * speed;
    camera.y -= sinf(camera.angle) * speed;
@@ -165,13 +475,13 @@ void strafeCamera(float speed)
 
 
 
-void rotateCamera(float deltaangle)
+void rotateCamera(camera_t &camera, float deltaangle)
 {
    camera.angle += deltaangle;
 }
 
 
-void flyCamera(float delta)
+void flyCamera(camera_t &camera, float delta)
 {
    camera.z += delta;
 }
@@ -204,20 +514,21 @@ struct wall_t
 };
 
 
-// Ideally, this would be the number of pixels that fit on a cache line.
-#define COLUMN_CHUNK_WIDTH 16
-rendercolumn_t columns[COLUMN_CHUNK_WIDTH] = {};
-
-void renderWall1s(wall_t wall)
+void renderWall1s(renderstrip_t &rs, wall_t wall)
 {
-   void *destBuffer = (void*)screen->getBuffer();
+   scopedtrace_t trace("renderWall1s");
+   const viewport_t &view = rs.ctx->view;
+   float *cliptop = rs.ctx->cliptop, *clipbot = rs.ctx->clipbot;
+   rendercolumn_t *columns = rs.columns;
+
+   void *destBuffer = (void*)rs.ctx->target->getBuffer();
    void *tex = (void*)texture->getBuffer();
 
    int x = wall.x1;
 
-   for (; x < wall.x2; x += COLUMN_CHUNK_WIDTH)
+   for (; x <= wall.x2; x += COLUMN_CHUNK_WIDTH)
    {
-      int lowy = screen->getHeight();
+      int lowy = view.height;
       int highy = -1;
 
       int chunkWidth = COLUMN_CHUNK_WIDTH;
@@ -229,7 +540,7 @@ void renderWall1s(wall_t wall)
       for (int i = 0; i < chunkWidth; ++i)
       {
          float basescale, yscale, xscale;
-         int t, b;
+         int t, b, m;
          int ctop, cbot;
          int columnx = x + i;
 
@@ -239,7 +550,7 @@ void renderWall1s(wall_t wall)
          t = wall.top < ctop ? ctop : (int)wall.top;
          b = wall.bottom > cbot ? cbot : (int)wall.bottom;
 
-         int m = t - 1 < cbot ? t - 1 : cbot;
+         m = t - 1 < cbot ? t - 1 : cbot;
          if (wall.markceiling && wall.ceilingp && m > ctop)
          {
 
@@ -255,8 +566,8 @@ void renderWall1s(wall_t wall)
          }
 
          // Close the column
-         cliptop[columnx] = b;
-         clipbot[columnx] = t;
+         cliptop[columnx] = view.height;
+         clipbot[columnx] = -1;
 
          if(t < lowy) lowy = t;
          if(b > highy) highy = b;
@@ -278,13 +589,19 @@ void renderWall1s(wall_t wall)
             columns[i].ystep = (int)(yscale * 65536.0);
             columns[i].texx = ((int)((wall.len * xscale) + wall.xoffset) & 0x3f) * 64;
 
-            columns[i].blend = calcLight(wall.dist, 0, wall.sector->light);
+            columns[i].blend = getLightBlend(wall.sector->lightid, wall.dist);
 
             columns[i].y1 = t;
             columns[i].y2 = b;
             columns[i].yfrac = (int)((((t - wall.tpeg + 1) * yscale) + wall.yoffset) * 65536.0);
 
             columns[i].tex = ((Uint32 *)tex) + columns[i].texx;
+
+            if(t <= b)
+            {
+               rs.stats.counters[STAT_COLUMNS]++;
+               rs.stats.counters[STAT_PIXELS] += b - t + 1;
+            }
          }
 
          wall.dist += wall.diststep;
@@ -296,116 +613,165 @@ void renderWall1s(wall_t wall)
 
       if(!wall.middle) continue;
 
-      drawColumnChunk(columns, destBuffer, chunkWidth, lowy, highy, x);
+      view.chunkfunc(columns, destBuffer, view.pitch, chunkWidth, lowy, highy, x);
    }
 }
 
 
-void renderWall2s(wall_t wall)
+// Like renderWall1s, the columns are set up a chunk at a time and then drawn row by row.
+// The upper and lower parts of the chunk are drawn separately, each only over the rows it
+// covers.
+void renderWall2s(renderstrip_t &rs, wall_t wall)
 {
-   float basescale, yscale, xscale;
-   int h, l, t, b, m;
-   int ctop, cbot;
-
-   rendercolumn_t column;
-   column.screen = (void *)screen->getBuffer();
-   column.tex = (void *)texture->getBuffer();
+   scopedtrace_t trace("renderWall2s");
+   const viewport_t &view = rs.ctx->view;
+   float *cliptop = rs.ctx->cliptop, *clipbot = rs.ctx->clipbot;
+   rendercolumn_t *uppers = rs.columns, *lowers = rs.lowercolumns;
 
-   // fairly straight forward.
-   for(int i = wall.x1; i <= wall.x2; i++)
-   {
-      if(cliptop[i] >= clipbot[i])
-         goto skip;
+   void *destBuffer = (void*)rs.ctx->target->getBuffer();
+   Uint32 *tex = (Uint32 *)texture->getBuffer();
 
-      ctop = (int)cliptop[i];
-      cbot = (int)clipbot[i];
+   int x = wall.x1;
 
-      t = wall.top < ctop ? ctop : (int)wall.top;
-      b = wall.bottom > cbot ? cbot : (int)wall.bottom;
+   for (; x <= wall.x2; x += COLUMN_CHUNK_WIDTH)
+   {
+      int upperlowy = view.height, upperhighy = -1;
+      int lowerlowy = view.height, lowerhighy = -1;
 
-      m = t - 1 < cbot ? t-1 : cbot;
-      if(wall.markceiling && wall.ceilingp && m > ctop)
+      int chunkWidth = COLUMN_CHUNK_WIDTH;
+      if (chunkWidth > (wall.x2 - x + 1))
       {
-
-         wall.ceilingp->top[i] = ctop;
-         wall.ceilingp->bot[i] = m;
+         chunkWidth = (wall.x2 - x + 1);
       }
 
-      m = b + 1 > ctop ? b + 1 : ctop;
-      if(wall.markfloor && wall.floorp && m < cbot)
+      for (int i = 0; i < chunkWidth; ++i)
       {
-         wall.floorp->top[i] = m;
-         wall.floorp->bot[i] = cbot;
-      }
+         float yscale = 0.0f, xscale = 0.0f;
+         int h, l, t, b, m;
+         int ctop, cbot;
+         int columnx = x + i;
+         Uint32 *source = NULL;
+         lightblend_t blend;
+         int ystep = 0;
 
-      if(wall.upper || wall.lower)
-      {
-         // the actual scale is y / yfov however, you have to divide 1 by dist (1/y)
-         // get y anyway so the resulting equasion is
-         //      1
-         // ------------
-         //   yfoc * y
-         basescale = yscale = xscale = 1.0f / (wall.dist * view.yfoc);
-
-         yscale *= wall.yscale;
-         xscale *= wall.xscale;
-
-         // Fixed numbers 16.16 format
-         column.ystep = (int)(yscale * 65536.0);
-         column.texx = ((int)((wall.len * xscale) + wall.xoffset) & 0x3f) * 64;
-         column.x = i;
-
-         column.blend = calcLight(wall.dist, 0, wall.sector->light);
-      }
+         // Nothing is drawn in a column unless it's opened up below.
+         uppers[i].y1 = lowers[i].y1 = 0;
+         uppers[i].y2 = lowers[i].y2 = -1;
 
-      if(wall.upper)
-      {
-         h = wall.high < ctop ? ctop : wall.high > cbot ? cbot : wall.high;
+         if(cliptop[columnx] >= clipbot[columnx])
+            goto skip;
+
+         ctop = (int)cliptop[columnx];
+         cbot = (int)clipbot[columnx];
 
-         column.y1 = t;
-         column.y2 = h;
+         t = wall.top < ctop ? ctop : (int)wall.top;
+         b = wall.bottom > cbot ? cbot : (int)wall.bottom;
 
-         if(t <= h)
+         m = t - 1 < cbot ? t-1 : cbot;
+         if(wall.markceiling && wall.ceilingp && m > ctop)
          {
-            column.yfrac = (int)((((column.y1 - wall.tpeg + 1) * yscale) + wall.yoffset) * 65536.0);
-            drawColumn(column);
-            cliptop[i] = h;
+
+            wall.ceilingp->top[columnx] = ctop;
+            wall.ceilingp->bot[columnx] = m;
          }
-         else
-            cliptop[i] = t;
-      }
-      else
-         cliptop[i] = t;
 
-      if(wall.lower)
-      {
-         l = wall.low < ctop ? ctop : wall.low > cbot ? cbot : wall.low;
+         m = b + 1 > ctop ? b + 1 : ctop;
+         if(wall.markfloor && wall.floorp && m < cbot)
+         {
+            wall.floorp->top[columnx] = m;
+            wall.floorp->bot[columnx] = cbot;
+         }
+
+         if(wall.upper || wall.lower)
+         {
+            // the actual scale is y / yfov however, you have to divide 1 by dist (1/y)
+            // get y anyway so the resulting equasion is
+            //      1
+            // ------------
+            //   yfoc * y
+            yscale = xscale = 1.0f / (wall.dist * view.yfoc);
+
+            yscale *= wall.yscale;
+            xscale *= wall.xscale;
+
+            // Fixed numbers 16.16 format
+            ystep = (int)(yscale * 65536.0);
+            source = tex + ((int)((wall.len * xscale) + wall.xoffset) & 0x3f) * 64;
+
+            blend = getLightBlend(wall.sector->lightid, wall.dist);
+         }
 
-         column.y1 = l;
-         column.y2 = b;
+         if(wall.upper)
+         {
+            h = wall.high < ctop ? ctop : wall.high > cbot ? cbot : wall.high;
+
+            if(t <= h)
+            {
+               uppers[i].y1 = t;
+               uppers[i].y2 = h;
+               uppers[i].yfrac = (int)((((t - wall.tpeg + 1) * yscale) + wall.yoffset) * 65536.0);
+               uppers[i].ystep = ystep;
+               uppers[i].tex = source;
+               uppers[i].blend = blend;
+
+               if(t < upperlowy) upperlowy = t;
+               if(h > upperhighy) upperhighy = h;
+
+               cliptop[columnx] = h;
+
+               rs.stats.counters[STAT_COLUMNS]++;
+               rs.stats.counters[STAT_PIXELS] += h - t + 1;
+            }
+            else
+               cliptop[columnx] = t;
+         }
+         else
+            cliptop[columnx] = t;
 
-         if(l <= b)
+         if(wall.lower)
          {
-            column.yfrac = (int)((((column.y1 - wall.lpeg + 1) * yscale) + wall.yoffset) * 65536.0);
-            drawColumn(column);
-            clipbot[i] = l;
+            l = wall.low < ctop ? ctop : wall.low > cbot ? cbot : wall.low;
+
+            if(l <= b)
+            {
+               lowers[i].y1 = l;
+               lowers[i].y2 = b;
+               lowers[i].yfrac = (int)((((l - wall.lpeg + 1) * yscale) + wall.yoffset) * 65536.0);
+               lowers[i].ystep = ystep;
+               lowers[i].tex = source;
+               lowers[i].blend = blend;
+
+               if(l < lowerlowy) lowerlowy = l;
+               if(b > lowerhighy) lowerhighy = b;
+
+               clipbot[columnx] = l;
+
+               rs.stats.counters[STAT_COLUMNS]++;
+               rs.stats.counters[STAT_PIXELS] += b - l + 1;
+            }
+            else
+               clipbot[columnx] = b;
          }
          else
-            clipbot[i] = b;
+            clipbot[columnx] = b;
+
+         skip:
+
+         wall.dist += wall.diststep;
+         wall.len += wall.lenstep;
+         wall.high += wall.highstep;
+         wall.low += wall.lowstep;
+         wall.top += wall.topstep;
+         wall.bottom += wall.bottomstep;
+         wall.tpeg += wall.tpegstep;
+         wall.lpeg += wall.lpegstep;
       }
-      else
-         clipbot[i] = b;
-
-      skip:
-
-      wall.dist += wall.diststep;
-      wall.len += wall.lenstep;
-      wall.high += wall.highstep;
-      wall.low += wall.lowstep;
-      wall.top += wall.topstep;
-      wall.bottom += wall.bottomstep;
-      wall.tpeg += wall.tpegstep;
-      wall.lpeg += wall.lpegstep;
+
+      // The row ranges are exclusive at the bottom.
+      if(upperhighy >= upperlowy)
+         view.chunkfunc(uppers, destBuffer, view.pitch, chunkWidth, upperlowy, upperhighy + 1, x);
+      if(lowerhighy >= lowerlowy)
+         view.chunkfunc(lowers, destBuffer, view.pitch, chunkWidth, lowerlowy, lowerhighy + 1, x);
    }
 }
 
@@ -413,59 +779,70 @@ void renderWall2s(wall_t wall)
 
 
 
-void projectWall(mapline_t *line)
+// Advances all the per-column values of the wall by amount columns.
+void stepWall(wall_t &wall, float amount)
 {
+   wall.len += wall.lenstep * amount;
+   wall.dist += wall.diststep * amount;
+
+   wall.high += wall.highstep * amount;
+   wall.low += wall.lowstep * amount;
+   wall.top += wall.topstep * amount;
+   wall.bottom += wall.bottomstep * amount;
+
+   wall.tpeg += wall.tpegstep * amount;
+   wall.lpeg += wall.lpegstep * amount;
+}
+
+
+
+// Projects and renders a seg. Only the columns inside range are drawn. Returns false if
+// the seg is back facing or falls outside of range, otherwise range is narrowed to the
+// columns the seg covers.
+bool projectWall(renderstrip_t &rs, mapseg_t *seg, wallrange_t &range)
+{
+   const camera_t &camera = rs.ctx->camera;
+   const viewport_t &view = rs.ctx->view;
+   const viewvertices_t &verts = rs.ctx->vertices;
+   wallrange_t *openranges = rs.openranges;
+   mapline_t *line = seg->line;
    float x1, x2;
    float i1, i2;
    float istep;
-   vector2f v1, v2, toffset;
+   vector2f toffset;
+   Uint32 index1, index2;
    mapside_t *side, *backside;
    mapsector_t *sector, *backsector;
 
    // Thses are the rounded xstart and xstop column values.
    int   floorx1, floorx2;
 
+   // The open parts of the wall
+   int   opencount, openx1, openx2;
+
    // These are used for slope calculations
    mapvertex_t *mv1, *mv2;
    float       leftclip = 0.0f, rightclip = 0.0f;
 
    vector2f  t1, t2;
 
-   if(line->v1->frameid == frameid)
-   {
-      t1.x = line->v1->t_x;
-      t1.y = line->v1->t_y;
-   }
-   else
-   {
-      v1.x = line->v1->x;
-      v1.y = line->v1->y;
+   scopedphase_t phase(rs.stats, PHASE_PROJECT);
+   scopedtrace_t trace("projectWall");
 
-      // Translate the vertices
-      t1 = v1 - vector2f(camera.x, camera.y);
-      // rotate
-      t1 = camera.rotmat.execute(t1);
-   }
-
-   if(line->v2->frameid == frameid)
-   {
-      t2.x = line->v2->t_x;
-      t2.y = line->v2->t_y;
-   }
-   else
-   {
-      v2.x = line->v2->x;
-      v2.y = line->v2->y;
+   // The vertices have already been transformed by transformVertices.
+   index1 = seg->v1->index;
+   index2 = seg->v2->index;
 
-      t2 = v2 - vector2f(camera.x, camera.y);
-      t2 = camera.rotmat.execute(t2);
-   }
+   t1.x = verts.tx[index1];
+   t1.y = verts.ty[index1];
+   t2.x = verts.tx[index2];
+   t2.y = verts.ty[index2];
 
    toffset.x = toffset.y = 0;
 
    // simple rejection for lines entirely behind the view plane
    if(t1.y < 1.0f && t2.y < 1.0f)
-      return;
+      return false;
 
    // projection:
    //                vertex.x * xfoc
@@ -496,20 +873,8 @@ void projectWall(mapline_t *line)
    }
    else
    {
-      if(line->v1->frameid == frameid)
-      {
-         i1 = line->v1->idistance;
-         x1 = line->v1->proj_x;
-      }
-      else
-      {
-         line->v1->idistance = i1 = 1.0f / t1.y; // Calculate 1/y used for oh-so-much
-         line->v1->proj_x = x1 = view.xcenter + (t1.x * i1 * view.xfoc);
-
-         line->v1->t_x = t1.x;
-         line->v1->t_y = t1.y;
-         line->v1->frameid = frameid;
-      }
+      i1 = verts.idistance[index1];
+      x1 = verts.proj_x[index1];
    }
 
 
@@ -535,26 +900,15 @@ void projectWall(mapline_t *line)
    }
    else
    {
-      if(line->v2->frameid == frameid)
-      {
-         i2 = line->v2->idistance;
-         x2 = line->v2->proj_x;
-      }
-      else
-      {
-         line->v2->idistance = i2 = 1.0f / t2.y;
-         x2 = line->v2->proj_x = view.xcenter + (t2.x * i2 * view.xfoc);
-         line->v2->t_x = t2.x;
-         line->v2->t_y = t2.y;
-         line->v2->frameid = frameid;
-      }
+      i2 = verts.idistance[index2];
+      x2 = verts.proj_x[index2];
    }
 
    // back-face rejection
    if(x2 < x1)
    {
       if(!line->side[1])
-         return;
+         return false;
 
       side = line->side[1];
       backside = line->side[0];
@@ -575,13 +929,16 @@ void projectWall(mapline_t *line)
       leftclip = rightclip;
       rightclip = temp;
 
-      mv1 = line->v2;
-      mv2 = line->v1;
+      mv1 = seg->v2;
+      mv2 = seg->v1;
+
+      // The back side is textured starting from the line's v2.
+      toffset.x = line->length - seg->offset - seg->length;
    }
    else
    {
       if(!line->side[0])
-         return;
+         return false;
 
       side = line->side[0];
       backside = line->side[1];
@@ -589,8 +946,10 @@ void projectWall(mapline_t *line)
       sector = line->sector1;
       backsector = line->sector2;
 
-      mv1 = line->v1;
-      mv2 = line->v2;
+      mv1 = seg->v1;
+      mv2 = seg->v2;
+
+      toffset.x = seg->offset;
    }
 
    toffset.x += leftclip;
@@ -606,8 +965,15 @@ void projectWall(mapline_t *line)
    floorx2 = (float)floor(x2 - 0.001f);
 
    // off the screen rejection
-   if(floorx2 < 0 || floorx1 >= view.width)
-      return;
+   if(floorx2 < range.x1 || floorx1 > range.x2)
+      return false;
+
+   // Reject walls that are entirely hidden behind solid walls before any of the height
+   // setup is done.
+   opencount = getOpenRanges(rs, floorx1 > range.x1 ? floorx1 : range.x1,
+                             floorx2 < range.x2 ? floorx2 : range.x2, openranges);
+   if(!opencount)
+      return false;
 
    // determine the amount the 1/y changes each pixel to the right
    // 1/y changes linearly across the line where as y itself does not.
@@ -671,7 +1037,7 @@ void projectWall(mapline_t *line)
          z1 = zPositionAt(sector->cslope, mv1->x, mv1->y);
          z2 = zPositionAt(sector->cslope, mv2->x, mv2->y);
 
-         zfrac = (z2 - z1) / line->length;
+         zfrac = (z2 - z1) / seg->length;
 
          if(leftclip != 0)
             z1 += leftclip * zfrac;
@@ -695,7 +1061,7 @@ void projectWall(mapline_t *line)
          z1 = zPositionAt(sector->fslope, mv1->x, mv1->y);
          z2 = zPositionAt(sector->fslope, mv2->x, mv2->y);
 
-         zfrac = (z2 - z1) / line->length;
+         zfrac = (z2 - z1) / seg->length;
 
          if(leftclip != 0)
             z1 += leftclip * zfrac;
@@ -722,7 +1088,7 @@ void projectWall(mapline_t *line)
    }
    else
    {
-      bool lightsame = memcmp(&sector->light, &backsector->light, sizeof(light_t)) ? false : true;
+      bool lightsame = sector->lightid == backsector->lightid;
       bool planeinsite;
 
       float frontz1, frontz2, backz1, backz2, peg1, peg2;
@@ -735,7 +1101,7 @@ void projectWall(mapline_t *line)
          frontz1 = zPositionAt(sector->cslope, mv1->x, mv1->y);
          frontz2 = zPositionAt(sector->cslope, mv2->x, mv2->y);
 
-         zfrac = (frontz2 - frontz1) / line->length;
+         zfrac = (frontz2 - frontz1) / seg->length;
 
          if(leftclip != 0)
             frontz1 += leftclip * zfrac;
@@ -757,7 +1123,7 @@ void projectWall(mapline_t *line)
          backz1 = zPositionAt(backsector->cslope, mv1->x, mv1->y);
          backz2 = zPositionAt(backsector->cslope, mv2->x, mv2->y);
 
-         zfrac = (backz2 - backz1) / line->length;
+         zfrac = (backz2 - backz1) / seg->length;
 
          if(leftclip != 0)
             backz1 += leftclip * zfrac;
@@ -810,7 +1176,7 @@ void projectWall(mapline_t *line)
          frontz1 = zPositionAt(sector->fslope, mv1->x, mv1->y);
          frontz2 = zPositionAt(sector->fslope, mv2->x, mv2->y);
 
-         zfrac = (frontz2 - frontz1) / line->length;
+         zfrac = (frontz2 - frontz1) / seg->length;
 
          if(leftclip != 0)
             frontz1 += leftclip * zfrac;
@@ -832,7 +1198,7 @@ void projectWall(mapline_t *line)
          backz1 = zPositionAt(backsector->fslope, mv1->x, mv1->y);
          backz2 = zPositionAt(backsector->fslope, mv2->x, mv2->y);
 
-         zfrac = (backz2 - backz1) / line->length;
+         zfrac = (backz2 - backz1) / seg->length;
 
          if(leftclip != 0)
             backz1 += leftclip * zfrac;
@@ -879,67 +1245,77 @@ void projectWall(mapline_t *line)
    }
 
 
-   // clip to screen
-   if(x1 < 0.0f)
+   wall.high = high1;
+   wall.low = low1;
+   wall.top = top1;
+   wall.bottom = bottom1;
+
+   // clip to the range
+   if(x1 < range.x1)
    {
       // when clipping x1 all the values that are increased per-pixel need to be increased
-      // the amount x1 is jumping which would be newx1 - x1 but because newx1 is 0, the equasion
-      // is simplified to -x1
-      wall.len += wall.lenstep * -x1;
-      wall.dist += wall.diststep * -x1;
-
-      high1 += wall.highstep * -x1;
-      low1 += wall.lowstep * -x1;
-      top1 += wall.topstep * -x1;
-      bottom1 += wall.bottomstep * -x1;
-
-      wall.tpeg += wall.tpegstep * -x1;
-      wall.lpeg += wall.lpegstep * -x1;
+      // the amount x1 is jumping which is range.x1 - x1.
+      stepWall(wall, range.x1 - x1);
 
-      x1 = 0.0f;
-      floorx1 = 0;
+      x1 = (float)range.x1;
+      floorx1 = range.x1;
    }
 
-   if(x2 >= view.width)
+   if(floorx2 > range.x2)
    {
-      float clip = x2 - view.width;
-
-      x2 = view.width - 1;
-      floorx2 = view.width - 1;
+      x2 = (float)range.x2;
+      floorx2 = range.x2;
    }
 
+   // The planes only need to cover the open part of the wall.
+   openx1 = openranges[0].x1;
+   openx2 = openranges[opencount - 1].x2;
 
    if(wall.markfloor)
-      wall.floorp = checkVisplane(findVisplane(sector->floorz, sector->light, sector->fslope), floorx1, floorx2);
+      wall.floorp = checkVisplane(rs.planes, findVisplane(rs.planes, sector->floorz, sector->lightid, sector->light, sector->fslope), openx1, openx2);
    else
       wall.floorp = NULL;
 
    if(wall.markceiling)
-      wall.ceilingp = checkVisplane(findVisplane(sector->ceilingz, sector->light, sector->cslope), floorx1, floorx2);
+      wall.ceilingp = checkVisplane(rs.planes, findVisplane(rs.planes, sector->ceilingz, sector->lightid, sector->light, sector->cslope), openx1, openx2);
    else
       wall.ceilingp = NULL;
 
 
-   // Round the pixel values as a last step;
-   wall.x1 = floorx1;
-   wall.x2 = floorx2;
    wall.sector = sector;
 
-   wall.high = high1;
-   wall.low = low1;
-   wall.top = top1;
-   wall.bottom = bottom1;
-
    wall.xoffset = toffset.x;
    wall.yoffset = toffset.y;
 
    wall.xscale = side->xscale;
    wall.yscale = side->yscale;
 
-   if(!backsector)
-      renderWall1s(wall);
-   else
-      renderWall2s(wall);
+   // Only rasterize the parts of the wall that aren't behind solid walls.
+   for(int i = 0; i < opencount; i++)
+   {
+      wall_t part = wall;
+
+      stepWall(part, (float)(openranges[i].x1 - floorx1));
+      part.x1 = openranges[i].x1;
+      part.x2 = openranges[i].x2;
+
+      scopedphase_t wallphase(rs.stats, PHASE_WALLS);
+
+      if(!backsector)
+      {
+         renderWall1s(rs, part);
+         addSolidSeg(rs, part.x1, part.x2);
+      }
+      else
+      {
+         renderWall2s(rs, part);
+         addClosedColumns(rs, part.x1, part.x2);
+      }
+   }
+
+   range.x1 = openx1;
+   range.x2 = openx2;
+   return true;
 }
 
 
@@ -947,24 +1323,317 @@ void projectWall(mapline_t *line)
 
 
 
-void renderScene(void)
+// Returns true if any of the box may show through the strip's open columns, like doom's
+// R_CheckBBox. The corners are compared by their angle from the view direction, so boxes
+// that reach behind the camera need no clipping to the view plane.
+static bool checkBBox(renderstrip_t &rs, const float *box)
 {
-   unsigned i;
+   const camera_t &camera = rs.ctx->camera;
+   const viewport_t &view = rs.ctx->view;
+   const float *m = camera.rotmat.mat;
+   const float xs[4] = {box[BOXLEFT], box[BOXRIGHT], box[BOXRIGHT], box[BOXLEFT]};
+   const float ys[4] = {box[BOXTOP], box[BOXTOP], box[BOXBOTTOM], box[BOXBOTTOM]};
+   float a0 = 0.0f, lo = 0.0f, hi = 0.0f, left, right, half;
+   int sx1, sx2;
+   cliprange_t *r;
+
+   // Nothing down that side.
+   if(box[BOXLEFT] > box[BOXRIGHT])
+      return false;
+
+   if(camera.x >= box[BOXLEFT] && camera.x <= box[BOXRIGHT] &&
+      camera.y >= box[BOXBOTTOM] && camera.y <= box[BOXTOP])
+      return true;
+
+   // Transformed like transformVertices does, then measured from the first corner.
+   for(int i = 0; i < 4; i++)
+   {
+      float dx = xs[i] - camera.x, dy = ys[i] - camera.y;
+      float a = atan2f(dx * m[0] + dy * m[3] + m[6], dx * m[1] + dy * m[4] + m[7]);
 
-   screen->lock();
-   texture->lock();
+      if(i == 0)
+      {
+         a0 = a;
+         continue;
+      }
+
+      a -= a0;
+      if(a > pi)
+         a -= 2 * pi;
+      else if(a <= -pi)
+         a += 2 * pi;
+
+      if(a < lo)
+         lo = a;
+      if(a > hi)
+         hi = a;
+   }
+
+   // From outside, a box never spans half of the circle. Right next to it rounding can
+   // make it look like it does.
+   if(hi - lo >= pi - 0.01f)
+      return true;
+
+   half = atanf(view.tan);
+   left = a0 + lo;
+   right = a0 + hi;
+
+   if(left > half)
+   {
+      left -= 2 * pi;
+      right -= 2 * pi;
+   }
+   else if(right < -half)
+   {
+      left += 2 * pi;
+      right += 2 * pi;
+   }
+
+   if(left > half || right < -half)
+      return false;
+
+   // A column of slack either side covers the rounding of the walls' own projection.
+   sx1 = (int)floorf(view.xcenter + tanf(left < -half ? -half : left) * view.xfoc) - 1;
+   sx2 = (int)ceilf(view.xcenter + tanf(right > half ? half : right) * view.xfoc) + 1;
+
+   if(sx1 < rs.window.x1)
+      sx1 = rs.window.x1;
+   if(sx2 > rs.window.x2)
+      sx2 = rs.window.x2;
+   if(sx1 > sx2)
+      return false;
+
+   // Hidden when a single closed range covers every column of it.
+   for(r = rs.solidsegs; r->x2 < sx1; r++);
+
+   return sx1 < r->x1 || sx2 > r->x2;
+}
+
+
+// Walks the BSP tree front to back from the camera. Walls are projected nearest first so
+// the clipping arrays close up in order, and the walk stops as soon as every column is
+// closed. The back side of a node is skipped when its bounding box is already hidden. Only
+// the columns of the strip are drawn.
+void renderBSPNode(renderstrip_t &rs, int nodenum)
+{
+   bspnode_t *node;
+   int side;
+
+   if(nodenum == -1 || screenClosed(rs))
+      return;
+
+   node = nodelist + nodenum;
+   side = pointOnSide(rs.ctx->camera.x, rs.ctx->camera.y, node);
+
+   renderBSPNode(rs, node->children[side]);
+
+   for(Uint32 i = 0; i < node->segcount && !screenClosed(rs); i++)
+   {
+      wallrange_t range = rs.window;
+
+      rs.stats.counters[STAT_LINES]++;
+      if(!projectWall(rs, seglist + node->firstseg + i, range))
+         rs.stats.counters[STAT_LINESREJECTED]++;
+   }
+
+   if(checkBBox(rs, node->bbox[side ^ 1]))
+      renderBSPNode(rs, node->children[side ^ 1]);
+}
+
+
+
+// -- Portal rendering --
+// Sectors are assumed to be convex, so none of the walls of a sector can hide each other.
+// Starting from the camera's sector, every wall facing the camera is drawn and each
+// two-sided line becomes a portal into the sector behind it, clipped to the columns the
+// portal covers on screen. Sectors that can't be seen through any portal are never touched.
+#define MAX_PORTAL_DEPTH 64
+
+bool portalrender = false;
+
+void renderSectorPortals(renderstrip_t &rs, mapsector_t *sector, wallrange_t window, mapline_t *from, int depth)
+{
+   const camera_t &camera = rs.ctx->camera;
+
+   for(Uint32 i = 0; i < sector->linecount && !screenClosed(rs); i++)
+   {
+      mapline_t *line = sector->lines[i];
+      mapsector_t *backsector;
+      float side;
+
+      if(line == from)
+         continue;
+
+      // Only the side of the line that belongs to this sector can be seen from in here.
+      side = (camera.x - line->v1->x) * (line->v2->y - line->v1->y) -
+             (camera.y - line->v1->y) * (line->v2->x - line->v1->x);
+
+      if(line->sector1 == sector)
+      {
+         if(side <= 0.0f)
+            continue;
+         backsector = line->sector2;
+      }
+      else
+      {
+         if(side >= 0.0f)
+            continue;
+         backsector = line->sector1;
+      }
+
+      mapseg_t seg = {line->v1, line->v2, 0.0f, line->length, line};
+      wallrange_t range = window;
+
+      rs.stats.counters[STAT_LINES]++;
+      if(!projectWall(rs, &seg, range))
+      {
+         rs.stats.counters[STAT_LINESREJECTED]++;
+         continue;
+      }
+
+      if(backsector && range.x1 <= range.x2 && depth < MAX_PORTAL_DEPTH)
+         renderSectorPortals(rs, backsector, range, line, depth + 1);
+   }
+}
+
+
+
+// -- Strip rendering --
+// The screen can be split into vertical strips that are rendered as separate jobs. A strip
+// walks the map against its own solid segs, draws into its own visplane pool and then
+// renders those planes, and it never touches the clipping arrays or the target outside of
+// its own columns, so nothing is shared while rendering.
+int renderstrips = 1;
+
+
+static void renderStrip(void *data)
+{
+   renderstrip_t &rs = *(renderstrip_t *)data;
+   rendercontext_t &ctx = *rs.ctx;
+   scopedtrace_t trace("renderStrip");
+
+   clearStats(rs.stats);
+   reserveStripRanges(rs);
+   clearSolidSegs(rs, rs.window.x1, rs.window.x2);
+   unlinkPlanes(rs.planes, rs.window.x1, rs.window.x2);
+
+   if(ctx.viewsector)
+      renderSectorPortals(rs, ctx.viewsector, rs.window, NULL, 0);
+   else if(nodecount)
+      renderBSPNode(rs, 0);
+
+   rs.stats.counters[STAT_VISPLANES] += rs.planes.numvisplanes;
+   rs.stats.counters[STAT_VISPLANECHILDREN] += rs.planes.numchildren;
+
+   renderVisplanes(ctx, rs.planes, rs.stats);
+}
+
+
+static void renderStrips(rendercontext_t &ctx)
+{
+   jobgroup_t group;
+   int count = renderstrips;
+
+   if(count > ctx.numstrips)
+      count = ctx.numstrips;
+   if(count > ctx.view.width)
+      count = ctx.view.width;
+   if(count < 1)
+      count = 1;
+
+   for(int i = 0; i < count; i++)
+   {
+      renderstrip_t &rs = ctx.strips[i];
+
+      rs.window.x1 = ctx.view.width * i / count;
+      rs.window.x2 = ctx.view.width * (i + 1) / count - 1;
+      forkJob(group, renderStrip, &rs);
+   }
+
+   joinJobs(group);
+
+   for(int i = 0; i < count; i++)
+      addStats(ctx.stats, ctx.strips[i].stats);
+}
 
-   //screen->clear();
 
-   setupFrame();
 
-   for(i = 0; i < linecount; i++)
-      projectWall(&linelist[i]);
+void renderScene(rendercontext_t &ctx)
+{
+   Uint64 start = SDL_GetPerformanceCounter();
+   scopedtrace_t trace("renderScene");
+
+   clearStats(ctx.stats);
+
+   ctx.target->lock();
+
+   {
+      scopedphase_t phase(ctx.stats, PHASE_SETUP);
+      scopedtrace_t trace("setupFrame");
+      setupFrame(ctx);
+   }
+
+   ctx.viewsector = portalrender ? sectorAtPoint(ctx.camera.x, ctx.camera.y) : NULL;
+   renderStrips(ctx);
+
+   ctx.target->unlock();
+
+   ctx.stats.ticks[PHASE_FRAME] = SDL_GetPerformanceCounter() - start;
+}
+
+
 
-   renderVisplanes();
+static void renderSceneJob(void *data)
+{
+   renderScene(*(rendercontext_t *)data);
+}
+
+
+// Hands the frame time to the dynamic resolution controller and applies its scale to the
+// next frame.
+static void updateRenderScale(rendercontext_t &ctx)
+{
+   double framems = ctx.stats.ticks[PHASE_FRAME] * 1000.0 / SDL_GetPerformanceFrequency();
+
+   if(updateDynamicResolution(ctx.dynres, framems))
+      setRenderScale(ctx, ctx.dynres.scale);
+}
+
+
+
+void renderFrame(rendercontext_t &ctx)
+{
+   if(ctx.target->getPageCount() < 2)
+   {
+      renderScene(ctx);
+
+      {
+         scopedphase_t phase(ctx.stats, PHASE_FLIP);
+         vidDriver::flipVideoPage();
+      }
+
+      updateRenderScale(ctx);
+      return;
+   }
+
+   // The frame is rendered by the job threads while this thread presents the one before
+   // it. The screen is locked here rather than in renderScene because SDL wants the
+   // texture locked from the thread that owns the renderer.
+   renderstats_t flipstats;
+   jobgroup_t group;
+
+   clearStats(flipstats);
+   ctx.target->lock();
+   forkJob(group, renderSceneJob, &ctx);
+
+   {
+      scopedphase_t phase(flipstats, PHASE_FLIP);
+      vidDriver::presentVideoPage();
+   }
 
-   screen->unlock();
-   texture->unlock();
+   joinJobs(group);
+   vidDriver::swapVideoPages();
 
-   screen->flipVideoPage();
+   ctx.stats.ticks[PHASE_FLIP] = flipstats.ticks[PHASE_FLIP];
+   updateRenderScale(ctx);
 }
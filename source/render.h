@@ -21,109 +21,156 @@
 #pragma once
 
 #include "light.h"
+#include "draw32.h"
 #include "matrix.h"
 #include "video.h"
+#include "transform.h"
+#include "stats.h"
+#include "dynres.h"
 
-#define MAX_WIDTH  1920
-#define MAX_HEIGHT 1080
+// Per-column and per-row renderer arrays are allocated to this alignment so neighbouring
+// strips and threads don't share cache lines.
+#define CACHE_LINE_SIZE 64
 
-// -- Rendering --
-struct lightblend_t
+// -- Camera --
+struct camera_t
 {
-	Uint16 l_r, l_g, l_b;
-	Uint32 fogadd;
+   // rotmat is a matrix which is used to perform rotation operations on vertices
+   matrix2d  rotmat;
+   float     angle;
+   float     x, y, z;
 };
 
-struct slopelightblend_t
-{
-	float rf, gf, bf;
-	Uint32 fogadd;
-};
 
-struct rendercolumn_t
+
+struct viewport_t
 {
-   int x;
-   int y1, y2;
-   int yfrac, ystep;
-   int texx;
+   float xcenter, ycenter, xfoc, yfoc, focratio, fov;
+   float sin, cos, tan;
+   float leftangle, anglestep;
 
-   lightblend_t blend;
+   // The number of columns and rows projected. With a detailshift of 1 every column is two
+   // pixels wide. screenwidth is the width in pixels the view was set up for, an odd last
+   // pixel is left out at low detail.
+   int   width, height;
+   int   detailshift, screenwidth;
 
-   void *tex, *screen;
-};
+   // Pixels per row of the render target.
+   int   pitch;
 
+   // Light falloff factor for sloped planes.
+   float slopevis;
 
-struct renderspan_t
-{
-   int x1, x2, y;
-   int xfrac, yfrac, xstep, ystep;
+   // The drawers for the detail level.
+   chunkfunc_t       chunkfunc;
+   colfunc_t         colfunc;
+   spanfunc_t        spanfunc;
+   slopespanfunc_t   slopespanfunc;
+};
 
-   lightblend_t blend;
+// Screen buffer pointer
+extern   vidDriver *screen;
+extern   vidDriver *texture;
 
-   void *tex, *screen;
+// A horizontal range of screen columns, inclusive.
+struct wallrange_t
+{
+   int x1, x2;
 };
 
+struct mapsector_t;
+struct sv_t;
+struct renderstrip_t;
 
-struct rslopespan_t
+// -- Render context --
+// Everything that changes while one view of the map is rendered. Contexts only share the
+// map and the textures, so several of them can render at the same time on different
+// threads, each into its own target.
+struct rendercontext_t
 {
-   int x1, x2, y;
-   float iufrac, ivfrac, idfrac;
-   float iustep, ivstep, idstep;
+   camera_t       camera;
+   viewport_t     view;
 
-   int rfrac, gfrac, bfrac;
-   int rstep, gstep, bstep;
+   // The surface the scene is drawn into.
+   vidDriver      *target;
 
-   slopelightblend_t blend;
+   // Much like in doom. The screen clipping array starts out open and closes up as walls
+   // are rendered. Every strip only touches its own columns. Sized to view.width.
+   float          *cliptop, *clipbot;
+   void           *clipblock;
 
-   void *src, *dest;
-};
+   // 1 / the distance of every row from the center of the view, for flats. Sized to the
+   // target's height and filled in whenever the view is set up.
+   float          *rowidy;
+   void           *rowblock;
 
+   // Different for every frame of every context. Set by setupFrame, the flat row caches are
+   // keyed on it.
+   Uint32         planeframe;
 
-// -- bit-specific functions --
-Uint32 getFogColor(Uint16 level, Uint8 r, Uint8 g, Uint8 b);
-slopelightblend_t calcSlopeLight(float distance, float map, light_t light);
-lightblend_t calcLight(float distance, float map, light_t light);
-void drawColumnChunk(rendercolumn_t* columns, void* destBuffer, int chunkWidth, int lowy, int highy, int startx);
-void drawColumn(rendercolumn_t column);
-void drawSpan(renderspan_t span);
-void drawSlopedSpan(rslopespan_t slopespan);
+   // The texture vectors of every slope for camera, filled in by setupSlopes. Sized to
+   // slopecount.
+   sv_t           *slopevectors;
+   void           *slopeblock;
 
-// -- Camera --
-struct camera_t
-{
-   // rotmat is a matrix which is used to perform rotation operations on vertices
-   matrix2d  rotmat;
-   float     angle;
-   float     x, y, z;
-};
+   // The map vertices as seen from camera.
+   viewvertices_t vertices;
 
-extern camera_t camera;
+   // The sector portal rendering starts from, or NULL to walk the BSP tree.
+   mapsector_t    *viewsector;
 
+   // Every strip has its own solid segs, column chunk and visplane pool.
+   renderstrip_t  *strips;
+   int            numstrips;
 
-struct viewport_t
-{
-   float xcenter, ycenter, xfoc, yfoc, focratio, fov;
-   float sin, cos, tan;
-   float leftangle, anglestep;
-   int   width, height;
+   // What the last frame took. Filled in by renderScene, except for the flip phase which
+   // is up to whoever presents the target.
+   renderstats_t  stats;
+
+   // Picks the render scale between frames in renderFrame. Off unless targetms is set.
+   dynres_t       dynres;
 };
 
-extern viewport_t view;
+// -- Renderer options --
+// When set, the scene is drawn by flooding out from the camera's sector through two-sided
+// lines instead of walking the BSP tree.
+extern bool     portalrender;
 
-// Screen buffer pointer
-extern   vidDriver *screen;
-extern   vidDriver *texture;
-
-// Much like in doom. The screen clipping array starts out open and closes up as walls
-// are rendered.
-extern float    cliptop[MAX_WIDTH], clipbot[MAX_WIDTH];
+// The number of vertical strips the screen is split into. Each strip is rendered as its own
+// job, so this should be around the number of job threads.
+extern int      renderstrips;
 
 float safeCos(float ang);
 void wrapAngle(float *ang);
-void moveCamera(float speed);
-void strafeCamera(float speed);
-void rotateCamera(float deltaangle);
-void flyCamera(float delta);
-void renderScene(void);
+void moveCamera(camera_t &camera, float speed);
+void strafeCamera(camera_t &camera, float speed);
+void rotateCamera(camera_t &camera, float deltaangle);
+void flyCamera(camera_t &camera, float delta);
+
+// Renders the context's camera into its target. Contexts may be rendered from any thread,
+// but each one only from a single thread at a time.
+void renderScene(rendercontext_t &ctx);
+// Renders the scene and presents it. When the target is a screen with more than one page,
+// the scene is rendered on the job threads while the previous frame is presented, so what
+// is on screen lags one frame behind. Must be called from the thread that set the video
+// mode. Afterwards the render scale is updated if the context uses dynamic resolution.
+void renderFrame(rendercontext_t &ctx);
 void loadTextures(void);
-void initRenderer(void);
+
+// Sets up a context to render into target, which must be 32-bit. The per-column arrays are
+// sized to the target, so any size works. The camera is left as it is.
+void initRenderer(rendercontext_t &ctx, vidDriver *target);
+
+// Renders at scale times the size of the target from the next frame on. The view is drawn
+// at the top left of the target, and a screen stretches it to fill the window. Must not be
+// called while the context is being rendered.
+void setRenderScale(rendercontext_t &ctx, float scale);
+
+// Sets the detail level from the next frame on, like doom's detailshift. 0 is full detail,
+// 1 halves the horizontal resolution of walls and flats. Must not be called while the
+// context is being rendered.
+void setDetailShift(rendercontext_t &ctx, int detailshift);
+
+// Allocates size bytes aligned to CACHE_LINE_SIZE. block is freed first and set to what has
+// to be freed later.
+void *allocCacheAligned(void *&block, size_t size);
@@ -0,0 +1,147 @@
+//
+// Copyright(C) 2007-2017 Stephen McGranahan
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/
+//
+// Purpose: Per-frame render counters and phase timers
+// Authors: Stephen McGranahan
+//
+
+#include <SDL.h>
+#include <stdio.h>
+#include <string.h>
+#include "stats.h"
+
+
+bool statsenabled = false;
+
+static FILE *statsfile = NULL;
+
+static const char *counternames[NUMSTATCOUNTERS] = {
+   "lines", "linesrejected", "columns", "spans", "pixels", "visplanes", "visplanechildren"
+};
+
+static const char *phasenames[NUMSTATPHASES] = {
+   "frame", "setup", "project", "walls", "planes", "flip"
+};
+
+
+void clearStats(renderstats_t &stats)
+{
+   memset(&stats, 0, sizeof(stats));
+   stats.curphase = -1;
+}
+
+
+void addStats(renderstats_t &to, const renderstats_t &from)
+{
+   for(int i = 0; i < NUMSTATCOUNTERS; i++)
+      to.counters[i] += from.counters[i];
+
+   for(int i = 0; i < NUMSTATPHASES; i++)
+      to.ticks[i] += from.ticks[i];
+}
+
+
+const char *getStatCounterName(int counter)
+{
+   return counter >= 0 && counter < NUMSTATCOUNTERS ? counternames[counter] : "";
+}
+
+
+const char *getStatPhaseName(int phase)
+{
+   return phase >= 0 && phase < NUMSTATPHASES ? phasenames[phase] : "";
+}
+
+
+double getStatPhaseMS(const renderstats_t &stats, int phase)
+{
+   static double freq = (double)SDL_GetPerformanceFrequency();
+
+   return (double)stats.ticks[phase] * 1000.0 / freq;
+}
+
+
+void formatStats(const renderstats_t &stats, char *buf, size_t size)
+{
+   snprintf(buf, size, "frame %.2f setup %.2f project %.2f walls %.2f planes %.2f flip %.2f ms, "
+            "%llu/%llu lines, %llu columns, %llu spans, %llu px, %llu planes",
+            getStatPhaseMS(stats, PHASE_FRAME), getStatPhaseMS(stats, PHASE_SETUP),
+            getStatPhaseMS(stats, PHASE_PROJECT), getStatPhaseMS(stats, PHASE_WALLS),
+            getStatPhaseMS(stats, PHASE_PLANES), getStatPhaseMS(stats, PHASE_FLIP),
+            (unsigned long long)(stats.counters[STAT_LINES] - stats.counters[STAT_LINESREJECTED]),
+            (unsigned long long)stats.counters[STAT_LINES],
+            (unsigned long long)stats.counters[STAT_COLUMNS],
+            (unsigned long long)stats.counters[STAT_SPANS],
+            (unsigned long long)stats.counters[STAT_PIXELS],
+            (unsigned long long)stats.counters[STAT_VISPLANES]);
+}
+
+
+bool openStatsFile(const char *filename)
+{
+   statsfile = fopen(filename, "w");
+   if(!statsfile)
+      return false;
+
+   fprintf(statsfile, "frame");
+   for(int i = 0; i < NUMSTATPHASES; i++)
+      fprintf(statsfile, ",%s_ms", phasenames[i]);
+   for(int i = 0; i < NUMSTATCOUNTERS; i++)
+      fprintf(statsfile, ",%s", counternames[i]);
+   fprintf(statsfile, "\n");
+
+   statsenabled = true;
+   return true;
+}
+
+
+void writeStatsFile(unsigned int frame, const renderstats_t &stats)
+{
+   if(!statsfile)
+      return;
+
+   fprintf(statsfile, "%u", frame);
+   for(int i = 0; i < NUMSTATPHASES; i++)
+      fprintf(statsfile, ",%.4f", getStatPhaseMS(stats, i));
+   for(int i = 0; i < NUMSTATCOUNTERS; i++)
+      fprintf(statsfile, ",%llu", (unsigned long long)stats.counters[i]);
+   fprintf(statsfile, "\n");
+   fflush(statsfile);
+}
+
+
+void scopedphase_t::enter(int phase)
+{
+   Uint64 now = SDL_GetPerformanceCounter();
+
+   outer = stats->curphase;
+   if(outer >= 0)
+      stats->ticks[outer] += now - stats->phasestart;
+
+   stats->curphase = phase;
+   stats->phasestart = now;
+}
+
+
+void scopedphase_t::leave(void)
+{
+   Uint64 now = SDL_GetPerformanceCounter();
+
+   stats->ticks[stats->curphase] += now - stats->phasestart;
+
+   stats->curphase = outer;
+   stats->phasestart = now;
+}
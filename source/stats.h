@@ -0,0 +1,111 @@
+//
+// Copyright(C) 2007-2017 Stephen McGranahan
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/
+//
+// Purpose: Per-frame render counters and phase timers
+// Authors: Stephen McGranahan
+//
+
+#pragma once
+
+#include <stddef.h>
+
+// -- Render stats --
+// Every render context collects a renderstats_t for each frame it renders. The counters are
+// always kept, they are cheap. The phase timers only run while statsenabled is set, except
+// for PHASE_FRAME which dynamic resolution needs.
+enum
+{
+   STAT_LINES,             // Segs and portal lines handed to projectWall
+   STAT_LINESREJECTED,     // ... that turned out to be back facing, off screen or hidden
+   STAT_COLUMNS,           // Wall columns drawn
+   STAT_SPANS,             // Flat and sloped spans drawn
+   STAT_PIXELS,            // Pixels written by the column and span drawers
+   STAT_VISPLANES,         // Visplanes allocated, children included
+   STAT_VISPLANECHILDREN,  // Child visplanes created by checkVisplane
+   NUMSTATCOUNTERS
+};
+
+enum
+{
+   PHASE_FRAME,            // All of renderScene
+   PHASE_SETUP,            // setupFrame
+   PHASE_PROJECT,          // projectWall, minus the rasterization below
+   PHASE_WALLS,            // renderWall1s and renderWall2s
+   PHASE_PLANES,           // renderVisplane
+   PHASE_FLIP,             // Presenting the frame, see renderFrame
+   NUMSTATPHASES
+};
+
+struct renderstats_t
+{
+   Uint64   counters[NUMSTATCOUNTERS];
+
+   // In performance counter ticks. Phases are timed separately in every job, so with
+   // more than one job thread they add up to more than the frame took.
+   Uint64   ticks[NUMSTATPHASES];
+
+   // The innermost running phase timer, or -1, and when it last started counting.
+   int      curphase;
+   Uint64   phasestart;
+};
+
+extern bool statsenabled;
+
+void clearStats(renderstats_t &stats);
+
+// Adds the counters and times of from to to.
+void addStats(renderstats_t &to, const renderstats_t &from);
+
+const char *getStatCounterName(int counter);
+const char *getStatPhaseName(int phase);
+double getStatPhaseMS(const renderstats_t &stats, int phase);
+
+// Writes a one line summary of the frame into buf, for the window title.
+void formatStats(const renderstats_t &stats, char *buf, size_t size);
+
+// Opens a CSV file to write one row per frame to and turns on statsenabled. Returns false if
+// the file can't be opened.
+bool openStatsFile(const char *filename);
+
+// Writes a row to the stats file, if one is open.
+void writeStatsFile(unsigned int frame, const renderstats_t &stats);
+
+// -- Phase timers --
+// Times a phase for as long as the timer is in scope. Phases are exclusive: a timer that
+// starts inside another one pauses the outer one until it goes out of scope, so the time
+// spent drawing a wall isn't also counted as projecting it.
+class scopedphase_t
+{
+   public:
+   scopedphase_t(renderstats_t &s, int phase) : stats(statsenabled ? &s : NULL)
+   {
+      if(stats)
+         enter(phase);
+   }
+
+   ~scopedphase_t()
+   {
+      if(stats)
+         leave();
+   }
+
+   private:
+   void enter(int phase);
+   void leave(void);
+
+   renderstats_t  *stats;
+   int            outer;
+};
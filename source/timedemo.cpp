@@ -0,0 +1,194 @@
+//
+// Copyright(C) 2007-2017 Stephen McGranahan
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/
+//
+// Purpose: Scripted camera paths and frame time benchmarking
+// Authors: Stephen McGranahan
+//
+
+#include <SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "render.h"
+#include "mapdata.h"
+#include "timedemo.h"
+
+
+// Starting from the spot main puts the camera: look all the way around, walk up to the
+// doorway of the small sector and look into it, sidestep across the room while turning,
+// bob up and down, then back off to the far wall.
+static demostep_t defaultsteps[] = {
+   {120,  0.0f,   0.0f,   0.0524f,  0.0f},
+   { 60,  2.5f,   0.0f,   0.0f,     0.0f},
+   { 40,  0.0f,   0.0f,  -0.0150f,  0.0f},
+   { 80,  0.0f,   0.0f,   0.0150f,  0.0f},
+   { 40,  0.0f,   0.0f,  -0.0150f,  0.0f},
+   { 60,  0.0f,   1.0f,  -0.0100f,  0.0f},
+   { 60,  0.0f,  -2.0f,   0.0200f,  0.0f},
+   { 40,  0.0f,   0.0f,   0.0f,     0.8f},
+   { 80,  0.0f,   0.0f,   0.0f,    -0.8f},
+   { 40,  0.0f,   0.0f,   0.0f,     0.8f},
+   { 60,  0.0f,   1.0f,  -0.0100f,  0.0f},
+   {120, -3.0f,   0.0f,   0.0262f,  0.0f},
+};
+
+static timedemo_t defaultdemo = {defaultsteps, sizeof(defaultsteps) / sizeof(demostep_t)};
+
+
+const timedemo_t &getDefaultTimedemo(void)
+{
+   return defaultdemo;
+}
+
+
+bool loadTimedemo(const char *filename, timedemo_t &demo)
+{
+   FILE *f = fopen(filename, "r");
+   char line[256];
+   int maxsteps = 0;
+
+   if(!f)
+      return false;
+
+   demo.steps = NULL;
+   demo.numsteps = 0;
+
+   while(fgets(line, sizeof(line), f))
+   {
+      demostep_t step;
+      char *c = line;
+
+      while(*c == ' ' || *c == '\t')
+         c++;
+      if(*c == '#' || *c == '\n' || *c == '\r' || !*c)
+         continue;
+
+      if(sscanf(c, "%d %f %f %f %f", &step.frames, &step.move, &step.strafe, &step.turn, &step.fly) != 5 ||
+         step.frames < 0)
+      {
+         fclose(f);
+         free(demo.steps);
+         demo.steps = NULL;
+         demo.numsteps = 0;
+         return false;
+      }
+
+      if(demo.numsteps == maxsteps)
+      {
+         maxsteps = maxsteps ? maxsteps * 2 : 32;
+         demo.steps = (demostep_t *)realloc(demo.steps, sizeof(demostep_t) * maxsteps);
+         if(!demo.steps)
+         {
+            fclose(f);
+            demo.numsteps = 0;
+            return false;
+         }
+      }
+
+      demo.steps[demo.numsteps++] = step;
+   }
+
+   fclose(f);
+   return demo.numsteps > 0;
+}
+
+
+static int compareFrameTimes(const void *a, const void *b)
+{
+   double x = *(const double *)a, y = *(const double *)b;
+
+   return x < y ? -1 : x > y ? 1 : 0;
+}
+
+
+// Nearest rank percentile of a sorted list.
+static double percentile(const double *sorted, int count, int pct)
+{
+   int rank = (count * pct + 99) / 100;
+
+   if(rank < 1)
+      rank = 1;
+
+   return sorted[rank - 1];
+}
+
+
+bool runTimedemo(rendercontext_t &ctx, const timedemo_t &demo)
+{
+   int totalframes = 0, frame = 0;
+   double *times, total = 0.0, freq;
+   Uint64 start, end;
+   SDL_Event e;
+
+   for(int i = 0; i < demo.numsteps; i++)
+      totalframes += demo.steps[i].frames;
+
+   if(!totalframes)
+      return true;
+
+   times = (double *)malloc(sizeof(double) * totalframes);
+   if(!times)
+      return false;
+
+   freq = (double)SDL_GetPerformanceFrequency();
+
+   for(int i = 0; i < demo.numsteps; i++)
+   {
+      const demostep_t &step = demo.steps[i];
+
+      for(int f = 0; f < step.frames; f++)
+      {
+         // Only the window can stop the demo early. Without a window there are no events.
+         while(SDL_PollEvent(&e))
+         {
+            if(e.type == SDL_QUIT || (e.type == SDL_KEYDOWN && e.key.keysym.scancode == SDL_SCANCODE_ESCAPE))
+            {
+               free(times);
+               return false;
+            }
+         }
+
+         moveCamera(ctx.camera, step.move);
+         strafeCamera(ctx.camera, step.strafe);
+         rotateCamera(ctx.camera, step.turn);
+         flyCamera(ctx.camera, step.fly);
+
+         start = SDL_GetPerformanceCounter();
+         renderFrame(ctx);
+         end = SDL_GetPerformanceCounter();
+
+         writeStatsFile(frameid, ctx.stats);
+         nextFrameID();
+
+         times[frame] = (double)(end - start) * 1000.0 / freq;
+         total += times[frame];
+         frame++;
+      }
+   }
+
+   // With a paged screen the last frame is still waiting to be shown.
+   if(ctx.target->getPageCount() > 1)
+      vidDriver::presentVideoPage();
+
+   qsort(times, frame, sizeof(double), compareFrameTimes);
+
+   printf("timedemo: %d frames in %.1f ms, %.1f fps\n", frame, total, total > 0.0 ? frame * 1000.0 / total : 0.0);
+   printf("timedemo: mean %.3f ms, p50 %.3f ms, p95 %.3f ms, p99 %.3f ms\n",
+          total / frame, percentile(times, frame, 50), percentile(times, frame, 95),
+          percentile(times, frame, 99));
+
+   free(times);
+   return true;
+}
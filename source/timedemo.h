@@ -0,0 +1,54 @@
+//
+// Copyright(C) 2007-2017 Stephen McGranahan
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/
+//
+// Purpose: Scripted camera paths and frame time benchmarking
+// Authors: Stephen McGranahan
+//
+
+#pragma once
+
+// -- Timedemos --
+// A timedemo is a list of steps. Each step moves the camera by the same amount every frame
+// for a number of frames, using the same camera functions as the keyboard controls. Since
+// the movement is per frame and not per millisecond, a demo always renders the same frames
+// no matter how fast the machine is.
+struct demostep_t
+{
+   int   frames;
+   float move, strafe, turn, fly;
+};
+
+struct timedemo_t
+{
+   demostep_t  *steps;
+   int         numsteps;
+};
+
+struct rendercontext_t;
+
+// The built in demo, a walk around the test map.
+const timedemo_t &getDefaultTimedemo(void);
+
+// Loads a demo from a text file. Every line is one step: frames move strafe turn fly.
+// Blank lines and lines starting with # are skipped. Returns false if the file could not be
+// read or a line is malformed.
+bool loadTimedemo(const char *filename, timedemo_t &demo);
+
+// Renders every frame of the demo from the context's current camera as fast as possible,
+// presenting each one through vidDriver::flipVideoPage (which does nothing when there is no
+// screen), then prints the frame time statistics to stdout. Returns false if the demo was
+// cut short by the window being closed.
+bool runTimedemo(rendercontext_t &ctx, const timedemo_t &demo);
@@ -0,0 +1,146 @@
+//
+// Copyright(C) 2007-2017 Stephen McGranahan
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/
+//
+// Purpose: Chrome trace event recording
+// Authors: Stephen McGranahan
+//
+
+#include <SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include "trace.h"
+
+
+// Must be a power of 2.
+#define TRACE_BUFFER_SIZE 65536
+
+struct traceevent_t
+{
+   const char  *name;
+   Uint64      start, end;
+};
+
+// Only the owning thread writes to a buffer. It fills in the event before bumping head, so a
+// reader that loads head sees complete events (unless the writer has lapped it since).
+struct tracebuffer_t
+{
+   traceevent_t         events[TRACE_BUFFER_SIZE];
+   std::atomic<Uint32>  head;
+   int                  threadid;
+
+   tracebuffer_t        *next;
+};
+
+bool traceenabled = false;
+
+static const char *tracefilename = NULL;
+static Uint64 tracestart;
+
+// Every thread that has recorded anything, newest first. Threads add themselves with a
+// compare and swap.
+static std::atomic<tracebuffer_t *> tracebuffers(NULL);
+static std::atomic<int> tracethreads(0);
+
+static thread_local tracebuffer_t *threadbuffer = NULL;
+
+
+static void writeTraceAtExit(void)
+{
+   if(tracefilename && !writeTrace(tracefilename))
+      fprintf(stderr, "Could not write trace %s\n", tracefilename);
+}
+
+
+void startTrace(const char *filename)
+{
+   tracefilename = filename;
+   tracestart = SDL_GetPerformanceCounter();
+   traceenabled = true;
+
+   atexit(writeTraceAtExit);
+}
+
+
+static tracebuffer_t *newTraceBuffer(void)
+{
+   tracebuffer_t *buffer = new tracebuffer_t;
+
+   buffer->head.store(0);
+   buffer->threadid = tracethreads++;
+   buffer->next = tracebuffers.load();
+
+   while(!tracebuffers.compare_exchange_weak(buffer->next, buffer))
+      ;
+
+   return buffer;
+}
+
+
+void addTraceEvent(const char *name, Uint64 start, Uint64 end)
+{
+   tracebuffer_t *buffer = threadbuffer;
+   Uint32 head;
+
+   if(!buffer)
+      buffer = threadbuffer = newTraceBuffer();
+
+   head = buffer->head.load(std::memory_order_relaxed);
+
+   traceevent_t &event = buffer->events[head & (TRACE_BUFFER_SIZE - 1)];
+   event.name = name;
+   event.start = start;
+   event.end = end;
+
+   buffer->head.store(head + 1, std::memory_order_release);
+}
+
+
+bool writeTrace(const char *filename)
+{
+   FILE *f = fopen(filename, "w");
+   double tous = 1000000.0 / (double)SDL_GetPerformanceFrequency();
+   bool first = true;
+
+   if(!f)
+      return false;
+
+   fprintf(f, "{\"traceEvents\": [\n");
+
+   for(tracebuffer_t *buffer = tracebuffers.load(); buffer; buffer = buffer->next)
+   {
+      Uint32 head = buffer->head.load(std::memory_order_acquire);
+      Uint32 i = head > TRACE_BUFFER_SIZE ? head - TRACE_BUFFER_SIZE : 0;
+
+      fprintf(f, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"thread %d\"}}",
+              first ? "" : ",\n", buffer->threadid, buffer->threadid);
+      first = false;
+
+      for(; i != head; i++)
+      {
+         const traceevent_t &event = buffer->events[i & (TRACE_BUFFER_SIZE - 1)];
+
+         fprintf(f, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                 event.name, buffer->threadid, (double)(Sint64)(event.start - tracestart) * tous,
+                 (double)(event.end - event.start) * tous);
+      }
+   }
+
+   fprintf(f, "\n]}\n");
+   fclose(f);
+
+   return true;
+}
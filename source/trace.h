@@ -0,0 +1,60 @@
+//
+// Copyright(C) 2007-2017 Stephen McGranahan
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/
+//
+// Purpose: Chrome trace event recording
+// Authors: Stephen McGranahan
+//
+
+#pragma once
+
+// -- Tracing --
+// Records when each traced section of code ran and on which thread, and writes it out in
+// the Chrome trace event format (chrome://tracing, ui.perfetto.dev). Every thread records
+// into its own ring buffer, so recording never takes a lock. When a buffer fills up the
+// oldest events are overwritten.
+extern bool traceenabled;
+
+// Turns tracing on. The trace is written to filename when the program exits.
+void startTrace(const char *filename);
+
+// Writes everything recorded so far. The buffers are read without stopping the threads
+// writing to them, so this should be called between frames.
+bool writeTrace(const char *filename);
+
+void addTraceEvent(const char *name, Uint64 start, Uint64 end);
+
+// Records the time between construction and destruction as one event. name must be a
+// string literal (or otherwise outlive the trace). When tracing is off this costs a test
+// of traceenabled.
+class scopedtrace_t
+{
+   public:
+   scopedtrace_t(const char *n) : name(traceenabled ? n : NULL)
+   {
+      if(name)
+         start = SDL_GetPerformanceCounter();
+   }
+
+   ~scopedtrace_t()
+   {
+      if(name)
+         addTraceEvent(name, start, SDL_GetPerformanceCounter());
+   }
+
+   private:
+   const char  *name;
+   Uint64      start;
+};
@@ -0,0 +1,147 @@
+//
+// Copyright(C) 2007-2017 Stephen McGranahan
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/
+//
+// Purpose: Per-frame vertex transformation
+// Authors: Stephen McGranahan
+//
+
+#include <SDL.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "error.h"
+#include "mapdata.h"
+#include "bsp.h"
+#include "render.h"
+#include "transform.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TRANSFORM_SSE2
+#endif
+
+
+vertexbuffer_t vertexbuffer;
+
+static float *vertexblock = NULL;
+
+
+// Every array is padded to a multiple of 4 so the transform never needs a scalar tail.
+static Uint32 paddedVertexCount(void)
+{
+   return (vertexbuffer.count + 3) & ~3u;
+}
+
+
+// Allocates count floats, 16 byte aligned. block is what has to be freed.
+static float *allocVertexArrays(float *&block, Uint32 count)
+{
+   free(block);
+   block = (float *)calloc(count + 4, sizeof(float));
+   if(!block)
+      fatalError::Throw("allocVertexArrays: out of memory");
+
+   return (float *)(((uintptr_t)block + 15) & ~(uintptr_t)15);
+}
+
+
+void initVertexBuffer(void)
+{
+   Uint32 i, padded;
+   float *base;
+
+   vertexbuffer.count = vertexcount + splitvertexcount;
+
+   padded = paddedVertexCount();
+   base = allocVertexArrays(vertexblock, padded * 2);
+
+   vertexbuffer.x = base;
+   vertexbuffer.y = base + padded;
+
+   for(i = 0; i < vertexcount; i++)
+   {
+      vertexlist[i].index = i;
+      vertexbuffer.x[i] = vertexlist[i].x;
+      vertexbuffer.y[i] = vertexlist[i].y;
+   }
+
+   for(i = 0; i < splitvertexcount; i++)
+   {
+      mapvertex_t *v = splitvertexlist + i;
+
+      v->index = vertexcount + i;
+      vertexbuffer.x[v->index] = v->x;
+      vertexbuffer.y[v->index] = v->y;
+   }
+}
+
+
+void initViewVertices(viewvertices_t &verts)
+{
+   Uint32 padded = paddedVertexCount();
+   float *base = allocVertexArrays(verts.block, padded * 4);
+
+   verts.tx = base;
+   verts.ty = base + padded;
+   verts.idistance = base + padded * 2;
+   verts.proj_x = base + padded * 3;
+}
+
+
+void transformVertices(viewvertices_t &verts, const camera_t &camera, const viewport_t &view)
+{
+   // Translate by the camera and rotate, the same as matrix2d::execute.
+   const float *m = camera.rotmat.mat;
+   Uint32 i = 0;
+
+#ifdef TRANSFORM_SSE2
+   __m128 cx = _mm_set1_ps(camera.x), cy = _mm_set1_ps(camera.y);
+   __m128 m0 = _mm_set1_ps(m[0]), m1 = _mm_set1_ps(m[1]);
+   __m128 m3 = _mm_set1_ps(m[3]), m4 = _mm_set1_ps(m[4]);
+   __m128 m6 = _mm_set1_ps(m[6]), m7 = _mm_set1_ps(m[7]);
+   __m128 xcenter = _mm_set1_ps(view.xcenter), xfoc = _mm_set1_ps(view.xfoc);
+   __m128 one = _mm_set1_ps(1.0f);
+
+   for(; i < vertexbuffer.count; i += 4)
+   {
+      __m128 dx = _mm_sub_ps(_mm_load_ps(vertexbuffer.x + i), cx);
+      __m128 dy = _mm_sub_ps(_mm_load_ps(vertexbuffer.y + i), cy);
+
+      __m128 tx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, m0), _mm_mul_ps(dy, m3)), m6);
+      __m128 ty = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, m1), _mm_mul_ps(dy, m4)), m7);
+
+      __m128 idist = _mm_div_ps(one, ty);
+      __m128 projx = _mm_add_ps(xcenter, _mm_mul_ps(_mm_mul_ps(tx, idist), xfoc));
+
+      _mm_store_ps(verts.tx + i, tx);
+      _mm_store_ps(verts.ty + i, ty);
+      _mm_store_ps(verts.idistance + i, idist);
+      _mm_store_ps(verts.proj_x + i, projx);
+   }
+#else
+   for(; i < vertexbuffer.count; i++)
+   {
+      float dx = vertexbuffer.x[i] - camera.x;
+      float dy = vertexbuffer.y[i] - camera.y;
+      float tx = dx * m[0] + dy * m[3] + m[6];
+      float ty = dx * m[1] + dy * m[4] + m[7];
+
+      verts.tx[i] = tx;
+      verts.ty[i] = ty;
+      verts.idistance[i] = 1.0f / ty;
+      verts.proj_x[i] = view.xcenter + (tx * verts.idistance[i] * view.xfoc);
+   }
+#endif
+}
@@ -0,0 +1,63 @@
+//
+// Copyright(C) 2007-2017 Stephen McGranahan
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/
+//
+// Purpose: Per-frame vertex transformation
+// Authors: Stephen McGranahan
+//
+
+#pragma once
+
+// -- Vertex buffer --
+// All of the vertices the renderer can reference (map vertices and the vertices created by
+// the node builder) are kept here as separate arrays, indexed by mapvertex_t::index. The
+// map space positions are set once at load time.
+struct vertexbuffer_t
+{
+   Uint32   count;
+
+   // Map space positions.
+   float    *x, *y;
+};
+
+extern vertexbuffer_t vertexbuffer;
+
+// -- View vertices --
+// The vertex buffer as seen from one camera. Every render context has its own set, filled
+// in every frame by transformVertices.
+struct viewvertices_t
+{
+   // View space positions, ty is the distance in front of the camera.
+   float    *tx, *ty;
+
+   // 1 / ty and the projected screen x. These are only valid for vertices with ty >= 1,
+   // anything closer has to be clipped to the view plane first.
+   float    *idistance, *proj_x;
+
+   float    *block;
+};
+
+struct camera_t;
+struct viewport_t;
+
+// Assigns every vertex its index and fills in the map space positions. Must be called after
+// the nodes are built.
+void initVertexBuffer(void);
+
+// Allocates the view vertices for everything in the vertex buffer.
+void initViewVertices(viewvertices_t &verts);
+
+// Transforms and projects every vertex for the given camera.
+void transformVertices(viewvertices_t &verts, const camera_t &camera, const viewport_t &view);
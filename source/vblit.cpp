@@ -22,6 +22,7 @@
 #include "video.h"
 #include "error.h"
 #include "pixelmath.h"
+#include "jobs.h"
 
 // 
 // Begin::vidDriver --------------------------------------------------------------------
@@ -59,135 +60,385 @@ void vidDriver::blitTo(vidDriver &dest, int srcx, int srcy, unsigned int w, unsi
 }
 
 
-void vidDriver::stretchBlitTo(vidDriver &dest, vidRect srcrect, vidRect destrect)
+// -- Stretch blitting --
+// The stretch blits are split into bands of rows that are run as jobs. Every band works out
+// the source row and step error the blit would have reached at its first row, so the result
+// is the same as blitting the rows in order.
+struct stretchblit_t
 {
-   bool lock1 = false, lock2 = false;
-   Uint8 *srcrow, *destrow;// pointers to the current row
-   Uint8 *psrc, *pdest;    // pointers to the current pixels
-   int  p1, p2;            // the two pitch values
-   int  widths, widthd;    // the width scale, and width delta
-   int  widthl;            // width limit
-   int  heights, heightd;  // the height scale, and height delta
-   int  heightl;           // height limit
-   int  y, x, pixelsize;
-   Uint16 *d2, *s2;
-   Uint32 *d4, *s4;
-   int  rowsize;
+   Uint8 *srcrow, *destrow;   // The first row of the source and destination
+   int   p1, p2;              // The two pitch values
+   int   widthd, widthl;      // The width delta and limit
+   int   heightd, heightl;    // The height delta and limit
+   int   bitdepth;
 
-   srcrect.clipRect(cliprect);
-   destrect.clipRect(dest.cliprect);
+   // Used by the translucent and lit blits.
+   unsigned char amount, amount2;
+   Uint16 subpixel16;
+   Uint32 subpixel32;
 
-   if(!locks)
+   void (*blitrow)(const stretchblit_t &blit, Uint8 *srcrow, Uint8 *destrow);
+};
+
+struct stretchband_t
+{
+   const stretchblit_t *blit;
+   int y1, y2;
+};
+
+// Bands smaller than this aren't worth the cost of a job.
+#define MIN_STRETCH_BAND 16
+#define MAX_STRETCH_BANDS 256
+
+
+static void stretchBand(void *data)
+{
+   stretchband_t *band = (stretchband_t *)data;
+   const stretchblit_t &blit = *band->blit;
+   long long step = (long long)band->y1 * blit.heightd;
+   Uint8 *srcrow = blit.srcrow + (step / blit.heightl) * blit.p1;
+   Uint8 *destrow = blit.destrow + band->y1 * blit.p2;
+   int heights = (int)(step % blit.heightl);
+
+   for(int y = band->y1; y < band->y2; y++)
    {
-      lock();
-      lock1 = true;
+      blit.blitrow(blit, srcrow, destrow);
+
+      heights += blit.heightd;
+
+      while(heights >= blit.heightl)
+      {
+         heights -= blit.heightl;
+         srcrow += blit.p1;
+      }
+
+      destrow += blit.p2;
    }
+}
 
-   if(!dest.locks)
+
+static void runStretchBlit(const stretchblit_t &blit)
+{
+   stretchband_t bands[MAX_STRETCH_BANDS];
+   jobgroup_t group;
+   int count, rows = blit.heightl;
+
+   if(rows <= 0)
+      return;
+
+   // A few bands per thread keeps the threads busy when some bands finish early.
+   count = getJobThreadCount() * 4;
+   if(count > rows / MIN_STRETCH_BAND)
+      count = rows / MIN_STRETCH_BAND;
+   if(count > MAX_STRETCH_BANDS)
+      count = MAX_STRETCH_BANDS;
+   if(count < 1)
+      count = 1;
+
+   for(int i = 0; i < count; i++)
    {
-      dest.lock();
-      lock2 = true;
+      bands[i].blit = &blit;
+      bands[i].y1 = rows * i / count;
+      bands[i].y2 = rows * (i + 1) / count;
+      forkJob(group, stretchBand, bands + i);
    }
 
-   pixelsize = dest.bitdepth / 8;
+   joinJobs(group);
+}
+
+
+static void stretchRow(const stretchblit_t &blit, Uint8 *srcrow, Uint8 *destrow)
+{
+   Uint8 *psrc, *pdest;
+   Uint16 *d2, *s2;
+   Uint32 *d4, *s4;
+   int widths = 0, x;
+
+   switch(blit.bitdepth)
+   {
+      case 8:
+         pdest = destrow;
+         psrc = srcrow;
+         for(x = blit.widthl; x--;)
+         {
+            *pdest++ = *psrc;
+            widths += blit.widthd;
+            while(widths >= blit.widthl)
+            {
+               psrc ++;
+               widths -= blit.widthl;
+            }
+         }
+         break;
+      case 16:
+         d2 = (Uint16 *)destrow, s2 = (Uint16 *)srcrow;
+         for(x = blit.widthl; x--;)
+         {
+            *d2++ = *s2;
+            widths += blit.widthd;
+            while(widths >= blit.widthl)
+            {
+               s2++;
+               widths -= blit.widthl;
+            }
+         }
+         break;
+      case 24:
+         pdest = destrow;
+         psrc = srcrow;
+         for(x = blit.widthl; x--;)
+         {
+            memcpy(pdest, psrc, 3);
+            pdest += 3;
+            widths += blit.widthd;
+            while(widths >= blit.widthl)
+            {
+               psrc += 3;
+               widths -= blit.widthl;
+            }
+         }
+         break;
+      case 32:
+         d4 = (Uint32 *)destrow, s4 = (Uint32 *)srcrow;
+
+         for(x = blit.widthl; x--;)
+         {
+            *d4++ = *s4;
+            widths += blit.widthd;
+            while(widths >= blit.widthl)
+            {
+               s4++;
+               widths -= blit.widthl;
+            }
+         }
+         break;
+   };
+}
 
-   // Set up the pointers
-   p1 = pitch;
-   srcrow = getBuffer() + (srcrect.rx() * pixelsize) + (p1 * srcrect.ry());
 
-   p2 = dest.pitch;
-   destrow = dest.getBuffer() + (destrect.rx() * pixelsize) + (p2 * destrect.ry());
+static void stretchRowAdd(const stretchblit_t &blit, Uint8 *srcrow, Uint8 *destrow)
+{
+   Uint8 *psrc, *pdest;
+   Uint16 *d2, *s2;
+   Uint32 *d4, *s4;
+   int widths = 0, x;
+
+   switch(blit.bitdepth)
+   {
+      case 16:
+         d2 = (Uint16 *)destrow, s2 = (Uint16 *)srcrow;
+         for(x = blit.widthl; x--;)
+         {
+            ADDPX16(*d2, *s2); d2++;
+            widths += blit.widthd;
+            while(widths >= blit.widthl)
+            {
+               s2++;
+               widths -= blit.widthl;
+            }
+         }
+         break;
+      case 24:
+         pdest = destrow;
+         psrc = srcrow;
+         for(x = blit.widthl; x--;)
+         {
+            ADDPX24(*(Uint32 *)pdest, *(Uint32 *)psrc);
+            pdest += 3;
+            widths += blit.widthd;
+            while(widths >= blit.widthl)
+            {
+               psrc += 3;
+               widths -= blit.widthl;
+            }
+         }
+         break;
+      case 32:
+         d4 = (Uint32 *)destrow, s4 = (Uint32 *)srcrow;
+
+         for(x = blit.widthl; x--;)
+         {
+            ADDPX32(*d4, *s4); d4++;
+            widths += blit.widthd;
+            while(widths >= blit.widthl)
+            {
+               s4++;
+               widths -= blit.widthl;
+            }
+         }
+         break;
+   };
+}
 
-   widthl = destrect.rw();
-   widthd = srcrect.rw();
-   heightl = destrect.rh();
-   heightd = srcrect.rh();
-   heights = 0;
 
-   rowsize = pixelsize * destrect.rw();
+static void stretchRowTrans(const stretchblit_t &blit, Uint8 *srcrow, Uint8 *destrow)
+{
+   Uint8 *psrc, *pdest;
+   Uint16 *d2, *s2;
+   Uint32 *d4, *s4;
+   int widths = 0, x;
+   unsigned char amount = blit.amount, amount2 = blit.amount2;
 
-   if(s->format->BitsPerPixel == dest.s->format->BitsPerPixel && 
-      s->format->Rmask == dest.s->format->Rmask &&
-      s->format->Gmask == dest.s->format->Gmask &&
-      s->format->Bmask == dest.s->format->Bmask &&
-      s->format->Amask == dest.s->format->Amask)
+   switch(blit.bitdepth)
    {
-      for(y = destrect.rh(); y--;)
-      {
-         widths = 0;
+      case 16:
+         d2 = (Uint16 *)destrow, s2 = (Uint16 *)srcrow;
+         for(x = blit.widthl; x--;)
+         {
+            TRANPX16i(*d2, *s2, amount, amount2); d2++;
+            widths += blit.widthd;
+            while(widths >= blit.widthl)
+            {
+               s2++;
+               widths -= blit.widthl;
+            }
+         }
+         break;
+      case 24:
+         pdest = destrow;
+         psrc = srcrow;
+         for(x = blit.widthl; x--;)
+         {
+            TRANPX24i(*(Uint32 *)pdest, *(Uint32 *)psrc, amount, amount2);
+            pdest += 3;
+            widths += blit.widthd;
+            while(widths >= blit.widthl)
+            {
+               psrc += 3;
+               widths -= blit.widthl;
+            }
+         }
+         break;
+      case 32:
+         d4 = (Uint32 *)destrow, s4 = (Uint32 *)srcrow;
 
-         switch(bitdepth)
+         for(x = blit.widthl; x--;)
          {
-            case 8:
-               pdest = destrow;
-               psrc = srcrow;
-               for(x = destrect.rw(); x--;)
-               {
-                  *pdest++ = *psrc;
-                  widths += widthd;
-                  while(widths >= widthl)
-                  {
-                     psrc ++;
-                     widths -= widthl;
-                  }
-               }
-               break;
-            case 16:
-               d2 = (Uint16 *)destrow, s2 = (Uint16 *)srcrow;
-               for(x = destrect.rw(); x--;)
-               {
-                  *d2++ = *s2;
-                  widths += widthd;
-                  while(widths >= widthl)
-                  {
-                     s2++;
-                     widths -= widthl;
-                  }
-               }
-               break;
-            case 24:
-               pdest = destrow;
-               psrc = srcrow;
-               for(x = destrect.rw(); x--;)
-               {
-                  memcpy(pdest, psrc, 3);
-                  pdest += 3;
-                  widths += widthd;
-                  while(widths >= widthl)
-                  {
-                     psrc += 3;
-                     widths -= widthl;
-                  }
-               }
-               break;
-            case 32:
-               d4 = (Uint32 *)destrow, s4 = (Uint32 *)srcrow;
-
-               for(x = destrect.rw(); x--;)
-               {
-                  *d4++ = *s4;
-                  widths += widthd;
-                  while(widths >= widthl)
-                  {
-                     s4++;
-                     widths -= widthl;
-                  }
-               }
-               break;
-         };
-   
-         heights += heightd;
-
-         while(heights >= heightl)
+            TRANPX32i(*d4, *s4, amount, amount2); d4++;
+            widths += blit.widthd;
+            while(widths >= blit.widthl)
+            {
+               s4++;
+               widths -= blit.widthl;
+            }
+         }
+         break;
+   };
+}
+
+
+static void stretchRowLited(const stretchblit_t &blit, Uint8 *srcrow, Uint8 *destrow)
+{
+   Uint8 *psrc, *pdest;
+   Uint16 *d2, *s2, subpixel16 = blit.subpixel16;
+   Uint32 *d4, *s4, subpixel32 = blit.subpixel32;
+   int widths = 0, x;
+
+   switch(blit.bitdepth)
+   {
+      case 16:
+         d2 = (Uint16 *)destrow, s2 = (Uint16 *)srcrow;
+         for(x = blit.widthl; x--;)
+         {
+            LIGHTPX16(*d2, *s2, subpixel16); d2++;
+            widths += blit.widthd;
+            while(widths >= blit.widthl)
+            {
+               s2++;
+               widths -= blit.widthl;
+            }
+         }
+         break;
+      case 24:
+         pdest = destrow;
+         psrc = srcrow;
+         for(x = blit.widthl; x--;)
          {
-            heights -= heightl;
-            srcrow += p1;
+            LIGHTPX24(*(Uint32 *)pdest, *(Uint32 *)psrc, subpixel32);
+            pdest += 3;
+            widths += blit.widthd;
+            while(widths >= blit.widthl)
+            {
+               psrc += 3;
+               widths -= blit.widthl;
+            }
          }
+         break;
+      case 32:
+         d4 = (Uint32 *)destrow, s4 = (Uint32 *)srcrow;
 
-         destrow += p2;
-      }
+         for(x = blit.widthl; x--;)
+         {
+            LIGHTPX32(*d4, *s4, subpixel32); d4++;
+            widths += blit.widthd;
+            while(widths >= blit.widthl)
+            {
+               s4++;
+               widths -= blit.widthl;
+            }
+         }
+         break;
+   };
+}
+
+
+// Fills in the parts of the blit that are the same for every kind of stretch blit.
+static void setupStretchBlit(stretchblit_t &blit, Uint8 *src, int srcpitch, vidRect &srcrect,
+                             Uint8 *dest, int destpitch, vidRect &destrect, int bitdepth)
+{
+   int pixelsize = bitdepth / 8;
+
+   blit.p1 = srcpitch;
+   blit.srcrow = src + (srcrect.rx() * pixelsize) + (blit.p1 * srcrect.ry());
+
+   blit.p2 = destpitch;
+   blit.destrow = dest + (destrect.rx() * pixelsize) + (blit.p2 * destrect.ry());
+
+   blit.widthl = destrect.rw();
+   blit.widthd = srcrect.rw();
+   blit.heightl = destrect.rh();
+   blit.heightd = srcrect.rh();
+
+   blit.bitdepth = bitdepth;
+}
+
+
+bool vidDriver::sameFormat(vidDriver &dest)
+{
+   return s->format->BitsPerPixel == dest.s->format->BitsPerPixel &&
+          s->format->Rmask == dest.s->format->Rmask &&
+          s->format->Gmask == dest.s->format->Gmask &&
+          s->format->Bmask == dest.s->format->Bmask &&
+          s->format->Amask == dest.s->format->Amask;
+}
+
+
+void vidDriver::stretchBlitTo(vidDriver &dest, vidRect srcrect, vidRect destrect)
+{
+   bool lock1 = false, lock2 = false;
+   stretchblit_t blit;
+
+   srcrect.clipRect(cliprect);
+   destrect.clipRect(dest.cliprect);
+
+   if(!locks)
+   {
+      lock();
+      lock1 = true;
    }
 
+   if(!dest.locks)
+   {
+      dest.lock();
+      lock2 = true;
+   }
+
+   setupStretchBlit(blit, getBuffer(), pitch, srcrect, dest.getBuffer(), dest.pitch, destrect, dest.bitdepth);
+   blit.blitrow = stretchRow;
+
+   if(sameFormat(dest))
+      runStretchBlit(blit);
+
    if(lock1)
       unlock();
 
@@ -199,17 +450,7 @@ void vidDriver::stretchBlitTo(vidDriver &dest, vidRect srcrect, vidRect destrect
 void vidDriver::stretchBlitAddTo(vidDriver &dest, vidRect srcrect, vidRect destrect)
 {
    bool lock1 = false, lock2 = false;
-   Uint8 *srcrow, *destrow;// pointers to the current row
-   Uint8 *psrc, *pdest;    // pointers to the current pixels
-   int  p1, p2;            // the two pitch values
-   int  widths, widthd;    // the width scale, and width delta
-   int  widthl;            // width limit
-   int  heights, heightd;  // the height scale, and height delta
-   int  heightl;           // height limit
-   int  y, x, pixelsize;
-   Uint16 *d2, *s2;
-   Uint32 *d4, *s4;
-   int  rowsize;
+   stretchblit_t blit;
 
    srcrect.clipRect(cliprect);
    destrect.clipRect(dest.cliprect);
@@ -226,92 +467,15 @@ void vidDriver::stretchBlitAddTo(vidDriver &dest, vidRect srcrect, vidRect destr
       lock2 = true;
    }
 
-   pixelsize = dest.bitdepth / 8;
-
-   // Set up the pointers
-   p1 = pitch;
-   srcrow = getBuffer() + (srcrect.rx() * pixelsize) + (p1 * srcrect.ry());
-
-   p2 = dest.pitch;
-   destrow = dest.getBuffer() + (destrect.rx() * pixelsize) + (p2 * destrect.ry());
-
-   widthl = destrect.rw();
-   widthd = srcrect.rw();
-   heightl = destrect.rh();
-   heightd = srcrect.rh();
-   heights = 0;
-
-   rowsize = pixelsize * destrect.rw();
+   setupStretchBlit(blit, getBuffer(), pitch, srcrect, dest.getBuffer(), dest.pitch, destrect, dest.bitdepth);
+   blit.blitrow = stretchRowAdd;
 
-   if(s->format->BitsPerPixel == dest.s->format->BitsPerPixel && 
-      s->format->Rmask == dest.s->format->Rmask &&
-      s->format->Gmask == dest.s->format->Gmask &&
-      s->format->Bmask == dest.s->format->Bmask &&
-      s->format->Amask == dest.s->format->Amask)
+   if(sameFormat(dest) && destrect.rh() > 0)
    {
-      for(y = destrect.rh(); y--;)
-      {
-         widths = 0;
-
-         switch(bitdepth)
-         {
-            case 16:
-               d2 = (Uint16 *)destrow, s2 = (Uint16 *)srcrow;
-               for(x = destrect.rw(); x--;)
-               {
-                  ADDPX16(*d2, *s2); d2++;
-                  widths += widthd;
-                  while(widths >= widthl)
-                  {
-                     s2++;
-                     widths -= widthl;
-                  }
-               }
-               break;
-            case 24:
-               pdest = destrow;
-               psrc = srcrow;
-               for(x = destrect.rw(); x--;)
-               {
-                  ADDPX24(*(Uint32 *)pdest, *(Uint32 *)psrc);
-                  pdest += 3;
-                  widths += widthd;
-                  while(widths >= widthl)
-                  {
-                     psrc += 3;
-                     widths -= widthl;
-                  }
-               }
-               break;
-            case 32:
-               d4 = (Uint32 *)destrow, s4 = (Uint32 *)srcrow;
-
-               for(x = destrect.rw(); x--;)
-               {
-                  ADDPX32(*d4, *s4); d4++;
-                  widths += widthd;
-                  while(widths >= widthl)
-                  {
-                     s4++;
-                     widths -= widthl;
-                  }
-               }
-               break;
-
-            default:
-               basicError::Throw("stretchBlitAddTo supports only 16, 24, and 32 but color modes.\n");
-         };
-   
-         heights += heightd;
-
-         while(heights >= heightl)
-         {
-            heights -= heightl;
-            srcrow += p1;
-         }
+      if(bitdepth != 16 && bitdepth != 24 && bitdepth != 32)
+         basicError::Throw("stretchBlitAddTo supports only 16, 24, and 32 but color modes.\n");
 
-         destrow += p2;
-      }
+      runStretchBlit(blit);
    }
 
    if(lock1)
@@ -328,17 +492,7 @@ void vidDriver::stretchBlitAddTo(vidDriver &dest, vidRect srcrect, vidRect destr
 void vidDriver::stretchBlitTransTo(vidDriver &dest, vidRect srcrect, vidRect destrect, unsigned char amount)
 {
    bool lock1 = false, lock2 = false;
-   Uint8 *srcrow, *destrow;// pointers to the current row
-   Uint8 *psrc, *pdest;    // pointers to the current pixels
-   int  p1, p2;            // the two pitch values
-   int  widths, widthd;    // the width scale, and width delta
-   int  widthl;            // width limit
-   int  heights, heightd;  // the height scale, and height delta
-   int  heightl;           // height limit
-   int  y, x, pixelsize;
-   Uint16 *d2, *s2;
-   Uint32 *d4, *s4;
-   int  rowsize;
+   stretchblit_t blit;
    unsigned char amount2 = 255 - amount;
 
    srcrect.clipRect(cliprect);
@@ -356,8 +510,6 @@ void vidDriver::stretchBlitTransTo(vidDriver &dest, vidRect srcrect, vidRect des
       lock2 = true;
    }
 
-   pixelsize = dest.bitdepth / 8;
-
    // Set up the translucency
    if(bitdepth == 16)
    {
@@ -365,90 +517,17 @@ void vidDriver::stretchBlitTransTo(vidDriver &dest, vidRect srcrect, vidRect des
       amount2 >>= 2;
    }
 
-   // Set up the pointers
-   p1 = pitch;
-   srcrow = getBuffer() + (srcrect.rx() * pixelsize) + (p1 * srcrect.ry());
+   setupStretchBlit(blit, getBuffer(), pitch, srcrect, dest.getBuffer(), dest.pitch, destrect, dest.bitdepth);
+   blit.blitrow = stretchRowTrans;
+   blit.amount = amount;
+   blit.amount2 = amount2;
 
-   p2 = dest.pitch;
-   destrow = dest.getBuffer() + (destrect.rx() * pixelsize) + (p2 * destrect.ry());
-
-   widthl = destrect.rw();
-   widthd = srcrect.rw();
-   heightl = destrect.rh();
-   heightd = srcrect.rh();
-   heights = 0;
-
-   rowsize = pixelsize * destrect.rw();
-
-   if(s->format->BitsPerPixel == dest.s->format->BitsPerPixel && 
-      s->format->Rmask == dest.s->format->Rmask &&
-      s->format->Gmask == dest.s->format->Gmask &&
-      s->format->Bmask == dest.s->format->Bmask &&
-      s->format->Amask == dest.s->format->Amask)
+   if(sameFormat(dest) && destrect.rh() > 0)
    {
-      for(y = destrect.rh(); y--;)
-      {
-         widths = 0;
+      if(bitdepth != 16 && bitdepth != 24 && bitdepth != 32)
+         basicError::Throw("stretchBlitTransTo supports only 16, 24, and 32 but color modes.\n");
 
-         switch(bitdepth)
-         {
-            case 16:
-               d2 = (Uint16 *)destrow, s2 = (Uint16 *)srcrow;
-               for(x = destrect.rw(); x--;)
-               {
-                  TRANPX16i(*d2, *s2, amount, amount2); d2++;
-                  widths += widthd;
-                  while(widths >= widthl)
-                  {
-                     s2++;
-                     widths -= widthl;
-                  }
-               }
-               break;
-            case 24:
-               pdest = destrow;
-               psrc = srcrow;
-               for(x = destrect.rw(); x--;)
-               {
-                  TRANPX24i(*(Uint32 *)pdest, *(Uint32 *)psrc, amount, amount2);
-                  pdest += 3;
-                  widths += widthd;
-                  while(widths >= widthl)
-                  {
-                     psrc += 3;
-                     widths -= widthl;
-                  }
-               }
-               break;
-            case 32:
-               d4 = (Uint32 *)destrow, s4 = (Uint32 *)srcrow;
-
-               for(x = destrect.rw(); x--;)
-               {
-                  TRANPX32i(*d4, *s4, amount, amount2); d4++;
-                  widths += widthd;
-                  while(widths >= widthl)
-                  {
-                     s4++;
-                     widths -= widthl;
-                  }
-               }
-               break;
-
-            default:
-               basicError::Throw("stretchBlitAddTo supports only 16, 24, and 32 but color modes.\n");
-         };
-   
-         heights += heightd;
-
-         while(heights >= heightl)
-         {
-            heights -= heightl;
-            srcrow += p1;
-         }
-
-         destrow += p2;
-      }
+      runStretchBlit(blit);
    }
 
    if(lock1)
@@ -464,17 +543,7 @@ void vidDriver::stretchBlitTransTo(vidDriver &dest, vidRect srcrect, vidRect des
 void vidDriver::stretchBlitLitedTo(vidDriver &dest, vidRect srcrect, vidRect destrect, Uint8 rlight, Uint8 glight, Uint8 blight)
 {
    bool lock1 = false, lock2 = false;
-   Uint8 *srcrow, *destrow;// pointers to the current row
-   Uint8 *psrc, *pdest;    // pointers to the current pixels
-   int  p1, p2;            // the two pitch values
-   int  widths, widthd;    // the width scale, and width delta
-   int  widthl;            // width limit
-   int  heights, heightd;  // the height scale, and height delta
-   int  heightl;           // height limit
-   int  y, x, pixelsize;
-   Uint16 *d2, *s2, subpixel16;
-   Uint32 *d4, *s4, subpixel32;
-   int  rowsize;
+   stretchblit_t blit;
 
    srcrect.clipRect(cliprect);
    destrect.clipRect(dest.cliprect);
@@ -491,106 +560,29 @@ void vidDriver::stretchBlitLitedTo(vidDriver &dest, vidRect srcrect, vidRect des
       lock2 = true;
    }
 
-   pixelsize = dest.bitdepth / 8;
+   setupStretchBlit(blit, getBuffer(), pitch, srcrect, dest.getBuffer(), dest.pitch, destrect, dest.bitdepth);
+   blit.blitrow = stretchRowLited;
 
    // Set up the translucency
    if(bitdepth == 16)
    {
-      subpixel16 = (((rlight) >> s->format->Rloss) << s->format->Rshift) |
-                   (((glight) >> s->format->Gloss) << s->format->Gshift) |
-                   (((blight) >> s->format->Bloss) << s->format->Bshift);
+      blit.subpixel16 = (((rlight) >> s->format->Rloss) << s->format->Rshift) |
+                        (((glight) >> s->format->Gloss) << s->format->Gshift) |
+                        (((blight) >> s->format->Bloss) << s->format->Bshift);
    }
    else
    {
-      subpixel32 = ((rlight) << s->format->Rshift) |
-                   ((glight) << s->format->Gshift) |
-                   ((blight) << s->format->Bshift);
+      blit.subpixel32 = ((rlight) << s->format->Rshift) |
+                        ((glight) << s->format->Gshift) |
+                        ((blight) << s->format->Bshift);
    }
 
-   // Set up the pointers
-   p1 = pitch;
-   srcrow = getBuffer() + (srcrect.rx() * pixelsize) + (p1 * srcrect.ry());
-
-   p2 = dest.pitch;
-   destrow = dest.getBuffer() + (destrect.rx() * pixelsize) + (p2 * destrect.ry());
-
-   widthl = destrect.rw();
-   widthd = srcrect.rw();
-   heightl = destrect.rh();
-   heightd = srcrect.rh();
-   heights = 0;
-
-   rowsize = pixelsize * destrect.rw();
-
-   if(s->format->BitsPerPixel == dest.s->format->BitsPerPixel && 
-      s->format->Rmask == dest.s->format->Rmask &&
-      s->format->Gmask == dest.s->format->Gmask &&
-      s->format->Bmask == dest.s->format->Bmask &&
-      s->format->Amask == dest.s->format->Amask)
+   if(sameFormat(dest) && destrect.rh() > 0)
    {
-      for(y = destrect.rh(); y--;)
-      {
-         widths = 0;
-
-         switch(bitdepth)
-         {
-            case 16:
-               d2 = (Uint16 *)destrow, s2 = (Uint16 *)srcrow;
-               for(x = destrect.rw(); x--;)
-               {
-                  LIGHTPX16(*d2, *s2, subpixel16); d2++;
-                  widths += widthd;
-                  while(widths >= widthl)
-                  {
-                     s2++;
-                     widths -= widthl;
-                  }
-               }
-               break;
-            case 24:
-               pdest = destrow;
-               psrc = srcrow;
-               for(x = destrect.rw(); x--;)
-               {
-                  LIGHTPX24(*(Uint32 *)pdest, *(Uint32 *)psrc, subpixel32);
-                  pdest += 3;
-                  widths += widthd;
-                  while(widths >= widthl)
-                  {
-                     psrc += 3;
-                     widths -= widthl;
-                  }
-               }
-               break;
-            case 32:
-               d4 = (Uint32 *)destrow, s4 = (Uint32 *)srcrow;
-
-               for(x = destrect.rw(); x--;)
-               {
-                  LIGHTPX32(*d4, *s4, subpixel32); d4++;
-                  widths += widthd;
-                  while(widths >= widthl)
-                  {
-                     s4++;
-                     widths -= widthl;
-                  }
-               }
-               break;
-
-            default:
-               basicError::Throw("stretchBlitAddTo supports only 16, 24, and 32 but color modes.\n");
-         };
-   
-         heights += heightd;
-
-         while(heights >= heightl)
-         {
-            heights -= heightl;
-            srcrow += p1;
-         }
+      if(bitdepth != 16 && bitdepth != 24 && bitdepth != 32)
+         basicError::Throw("stretchBlitLitedTo supports only 16, 24, and 32 but color modes.\n");
 
-         destrow += p2;
-      }
+      runStretchBlit(blit);
    }
 
    if(lock1)
@@ -600,9 +592,6 @@ void vidDriver::stretchBlitLitedTo(vidDriver &dest, vidRect srcrect, vidRect des
       dest.unlock();
 }
 
-
-
-
 /*void vidDriver::filterBlitTo(vidDriver &dest, vidRect srcrect, vidRect destrect)
 {
    bool lock1 = false, lock2 = false;
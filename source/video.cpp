@@ -21,6 +21,7 @@
 #include <SDL.h>
 #include "video.h"
 #include "error.h"
+#include "trace.h"
 
 // 
 // Begin::vidDriver --------------------------------------------------------------------
@@ -48,31 +49,24 @@ vidDriver::vidDriver(unsigned int w, unsigned int h, Uint8 bits)
          break;
    };
 
-   window = SDL_CreateWindow(
-      "cardboard 0.0.2",
-      SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-      w, h, SDL_WINDOW_ALLOW_HIGHDPI
-   );
-
-   if(!window)
-      basicError::Throw("vidDriver failed to allocate window.\n");
-
-   renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_TARGETTEXTURE);
-   if(!renderer)
-      basicError::Throw("vidDriver failed to allocate renderer.\n");
+   window = NULL;
+   renderer = NULL;
+   texture = NULL;
+   rgba_surface = NULL;
+   directpresent = false;
+   numpages = 1;
+   drawpage = 0;
+   frontpage = -1;
+   for(int i = 0; i < VID_MAXPAGES; i++)
+   {
+      pagetextures[i] = NULL;
+      pagesurfaces[i] = NULL;
+   }
 
    s = SDL_CreateRGBSurface(0, w, h, bits, rmask, gmask, bmask, amask);
    if(!s)
      basicError::Throw("vidDriver failed to allocate primary surface.\n");
 
-   rgba_surface = SDL_CreateRGBSurfaceWithFormat(0, w, h, 0, SDL_PIXELFORMAT_RGBA32);
-   if(!rgba_surface)
-       basicError::Throw("vidDriver failed to allocate RGBA surface.\n");
-
-   texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, w, h);
-
-   destrect = { 0, 0, static_cast<int>(w), static_cast<int>(h) };
-
    freesurface = true;
    locks = 0;
    mustlock = SDL_MUSTLOCK(s);
@@ -85,12 +79,27 @@ vidDriver::vidDriver(unsigned int w, unsigned int h, Uint8 bits)
    buffer = NULL;
    bitdepth = s->format->BitsPerPixel;
    cliprect.setRect(0, 0, width, height);
+   viewrect = { 0, 0, width, height };
    isscreen = false;
 }
 
 
 vidDriver::vidDriver(SDL_Surface &from, bool owns)
 {
+   window = NULL;
+   renderer = NULL;
+   texture = NULL;
+   rgba_surface = NULL;
+   directpresent = false;
+   numpages = 1;
+   drawpage = 0;
+   frontpage = -1;
+   for(int i = 0; i < VID_MAXPAGES; i++)
+   {
+      pagetextures[i] = NULL;
+      pagesurfaces[i] = NULL;
+   }
+
    s = NULL;
    setSurface(from, owns);
 }
@@ -542,7 +551,20 @@ void vidDriver::getColor(Uint32 color, Uint8 &r, Uint8 &g, Uint8 &b, Uint8 &a)
 
 void vidDriver::lock()
 {
-   if(mustlock)
+   if(directpresent && !locks)
+   {
+      void *pixels;
+      int texpitch;
+
+      if(SDL_LockTexture(texture, NULL, &pixels, &texpitch))
+         fatalError::Throw("vidDriver::lock could not lock the screen texture: %s\n", SDL_GetError());
+
+      // The texture can hand back different memory (and a different pitch) every time.
+      s->pixels = pixels;
+      s->pitch = pitch = texpitch;
+      abnormalpitch = (s->w * s->format->BytesPerPixel) == pitch ? false : true;
+   }
+   else if(mustlock)
       SDL_LockSurface(s);
 
    locks++;
@@ -554,16 +576,36 @@ void vidDriver::unlock()
 {
    if(locks)
    {
-      if(mustlock)
-         SDL_UnlockSurface(s);
-
       locks--;
+
+      if(directpresent)
+      {
+         if(!locks)
+         {
+            SDL_UnlockTexture(texture);
+            s->pixels = NULL;
+         }
+      }
+      else if(mustlock)
+         SDL_UnlockSurface(s);
    }
    buffer = NULL;
 }
 
 
 
+void vidDriver::setViewSize(int w, int h)
+{
+   if(w > width)
+      w = width;
+   if(h > height)
+      h = height;
+
+   viewrect = { 0, 0, w < 1 ? 1 : w, h < 1 ? 1 : h };
+}
+
+
+
 // Image file functions -----------------------------------------------------------------
 bool vidDriver::saveBMPFile(string filename)
 {
@@ -587,7 +629,7 @@ vidDriver *vidDriver::loadBMPFile(string filename)
 }
 
 // Screen stuffs ------------------------------------------------------------------------
-vidDriver *vidDriver::setVideoMode(unsigned int w, unsigned int h, int bits, int sdlflags)
+vidDriver *vidDriver::setVideoMode(unsigned int w, unsigned int h, int bits, int sdlflags, bool direct, int pages)
 {
    if(screensurface)
       screensurface->noLongerScreen();
@@ -598,6 +640,7 @@ vidDriver *vidDriver::setVideoMode(unsigned int w, unsigned int h, int bits, int
    //   return NULL;
 
    screensurface = new vidDriver(w, h, bits);
+   screensurface->openWindow(direct && bits == 32, pages);
    screensurface->isscreen = true;
    return screensurface;
 }
@@ -633,18 +676,58 @@ void vidDriver::flipVideoPage()
    if(!screensurface)
       return;
 
-   while(screensurface->locks)
-      screensurface->unlock();
+   scopedtrace_t trace("flipVideoPage");
+
+   swapVideoPages();
+   presentVideoPage();
+}
+
+
+void vidDriver::swapVideoPages()
+{
+   if(!screensurface)
+      return;
+
+   vidDriver &scr = *screensurface;
+
+   while(scr.locks)
+      scr.unlock();
      //fatalError::Throw("flipVideoPage called while the screen surface was locked.\n");
 
-   if(screensurface->s)
+   scr.frontpage = scr.drawpage;
+   scr.pagerects[scr.frontpage] = scr.viewrect;
+   scr.drawpage = (scr.drawpage + 1) % scr.numpages;
+
+   if(scr.directpresent)
+      scr.texture = scr.pagetextures[scr.drawpage];
+   else if(scr.pagesurfaces[scr.drawpage])
+      scr.s = scr.pagesurfaces[scr.drawpage];
+}
+
+
+void vidDriver::presentVideoPage()
+{
+   if(!screensurface || screensurface->frontpage < 0)
+      return;
+
+   vidDriver &scr = *screensurface;
+   SDL_Rect src = scr.pagerects[scr.frontpage];
+   scopedtrace_t trace("presentVideoPage");
+
+   // Only the drawn area is copied, the renderer does the stretching.
+   if(scr.directpresent)
+      SDL_RenderCopy(scr.renderer, scr.pagetextures[scr.frontpage], &src, &scr.destrect);
+   else
    {
-      SDL_BlitSurface(screensurface->s, nullptr, screensurface->rgba_surface, nullptr);
-      SDL_UpdateTexture(screensurface->texture, nullptr, screensurface->rgba_surface->pixels, screensurface->rgba_surface->pitch);
-      SDL_RenderCopy(screensurface->renderer, screensurface->texture, nullptr, &screensurface->destrect);
+      SDL_Surface *front = scr.pagesurfaces[scr.frontpage];
+      SDL_Rect dst = src;
+
+      SDL_BlitSurface(front, &src, scr.rgba_surface, &dst);
+      SDL_UpdateTexture(scr.texture, &src, scr.rgba_surface->pixels, scr.rgba_surface->pitch);
+      SDL_RenderCopy(scr.renderer, scr.texture, &src, &scr.destrect);
    }
 
-   SDL_RenderPresent(screensurface->renderer);
+   SDL_RenderPresent(scr.renderer);
 }
 
 void vidDriver::updateWindowTitle(const char *title)
@@ -671,10 +754,114 @@ void vidDriver::updateWindowTitle(const char *title)
 
 
 // Protected helper functions -----------------------------------------------------------
+void vidDriver::openWindow(bool direct, int pages)
+{
+   int w = s->w, h = s->h;
+
+   if(pages < 1)
+      pages = 1;
+   else if(pages > VID_MAXPAGES)
+      pages = VID_MAXPAGES;
+
+   window = SDL_CreateWindow(
+      "cardboard 0.0.2",
+      SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+      w, h, SDL_WINDOW_ALLOW_HIGHDPI
+   );
+
+   if(!window)
+      basicError::Throw("vidDriver failed to allocate window.\n");
+
+   renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_TARGETTEXTURE);
+   if(!renderer)
+      basicError::Throw("vidDriver failed to allocate renderer.\n");
+
+   destrect = { 0, 0, w, h };
+
+   // Smooths the stretch when less than the whole page is drawn.
+   SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
+
+   if(direct)
+   {
+      // RGB888 is the same layout as the 32-bit surfaces (x8r8g8b8), so the renderer can
+      // write into the texture without any conversion.
+      int i;
+
+      for(i = 0; i < pages; i++)
+      {
+         pagetextures[i] = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB888, SDL_TEXTUREACCESS_STREAMING, w, h);
+         if(!pagetextures[i])
+            break;
+      }
+
+      if(i == pages)
+      {
+         SDL_Surface *header =
+            SDL_CreateRGBSurfaceFrom(NULL, w, h, 32, w * 4, s->format->Rmask, s->format->Gmask,
+                                     s->format->Bmask, s->format->Amask);
+
+         if(!header)
+            basicError::Throw("vidDriver failed to allocate screen surface.\n");
+
+         // The surface only describes the format from now on, its pixels are the texture's
+         // while the screen is locked.
+         setSurface(*header, true);
+         directpresent = true;
+         numpages = pages;
+         texture = pagetextures[0];
+         return;
+      }
+
+      // Fall back to presenting through a copy.
+      while(i--)
+      {
+         SDL_DestroyTexture(pagetextures[i]);
+         pagetextures[i] = NULL;
+      }
+   }
+
+   pagesurfaces[0] = s;
+   for(int i = 1; i < pages; i++)
+   {
+      pagesurfaces[i] = SDL_CreateRGBSurface(0, w, h, s->format->BitsPerPixel, s->format->Rmask,
+                                             s->format->Gmask, s->format->Bmask, s->format->Amask);
+      if(!pagesurfaces[i])
+         basicError::Throw("vidDriver failed to allocate screen page.\n");
+   }
+   numpages = pages;
+
+   rgba_surface = SDL_CreateRGBSurfaceWithFormat(0, w, h, 0, SDL_PIXELFORMAT_RGBA32);
+   if(!rgba_surface)
+       basicError::Throw("vidDriver failed to allocate RGBA surface.\n");
+
+   texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, w, h);
+}
+
+
 void vidDriver::noLongerScreen()
 {
    if(!screensurface || s != screensurface->s)
       return;
+
+   if(directpresent)
+   {
+      // The screen never had pixels of its own, so there is nothing to keep.
+      while(locks)
+         unlock();
+
+      SDL_Surface *news = 
+         SDL_CreateRGBSurface(0, s->w, s->h, s->format->BitsPerPixel, s->format->Rmask,
+                              s->format->Gmask, s->format->Bmask, s->format->Amask);
+
+      if(!news)
+         fatalError::Throw("noLongerScreen failed to allocate surface.\n");
+
+      directpresent = false;
+      setSurface(*news, true);
+      screensurface = NULL;
+      return;
+   }
+
    // Create a copy of the object surface that is NOT a screen buffer.
    SDL_Surface *news = 
       SDL_CreateRGBSurfaceFrom(s->pixels, s->w, s->h, s->format->BitsPerPixel, s->pitch,
@@ -1072,6 +1259,11 @@ void vidDriver::setSurface(SDL_Surface &surface, bool owner)
 
    s = &surface;
 
+   // A surface set this way is never paged.
+   numpages = 1;
+   drawpage = 0;
+   frontpage = -1;
+
    freesurface = owner;
    locks = 0;
    mustlock = SDL_MUSTLOCK(s);
@@ -1085,6 +1277,7 @@ void vidDriver::setSurface(SDL_Surface &surface, bool owner)
    bitdepth = s->format->BitsPerPixel;
    SDL_GetClipRect(s, &clipr);
    cliprect.setSDLRect(clipr);
+   viewrect = { 0, 0, width, height };
    isscreen = false;
 }
 //
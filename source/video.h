@@ -22,6 +22,9 @@
 
 #include "rect.h"
 #include <string>
+
+// The most pages a screen surface can be opened with.
+#define VID_MAXPAGES 3
 using namespace std;
 
 // vidDriver ------------------------------------------------------------------------------
@@ -32,6 +35,8 @@ using namespace std;
 class vidDriver
 {
    public:
+   // Creates a plain surface in memory. Only setVideoMode opens a window, so this works
+   // without a display.
    vidDriver(unsigned int w, unsigned int h, Uint8 bits);
    vidDriver(SDL_Surface &from, bool owns);
    virtual ~vidDriver();
@@ -141,7 +146,8 @@ class vidDriver
 
    // Video stuffs -------------------------------------------------------------------------
    // Locks the surface and makes the pixel buffer available. This MUST be called before
-   // low-level pixel access is granted.
+   // low-level pixel access is granted. For a screen surface that presents directly, this
+   // locks the streaming texture and the buffer and pitch point into it.
    void lock();
    // Unlocks the image. This should be done prior to blitting or updating the screen (if
    // the surface is the screen surface).
@@ -154,6 +160,13 @@ class vidDriver
    unsigned int getHeight(void) const {return s ? s->h : 0;}
    unsigned int getPitch(void) const {return s ? pitch : 0;}
    unsigned int getPixelSize(void) const {return s ? s->format->BytesPerPixel : 0;}
+   // Number of pages the surface flips between, 1 for everything but a paged screen.
+   int getPageCount(void) const {return numpages;}
+
+   // Sets the size of the area at the top left of the surface that is drawn. For the screen
+   // only that area of a page is presented, stretched to fill the window. Clamped to the
+   // size of the surface.
+   void setViewSize(int w, int h);
 
 
    // Image file functions -----------------------------------------------------------------
@@ -171,12 +184,23 @@ class vidDriver
    // plan on using any of the functions in this section. If this function is called more than
    // once, the previous screen surface is demoted to a regular surface and the current contents
    // of the screen are kept in it.
-   static vidDriver *setVideoMode(unsigned int w, unsigned int h, int bits, int sdlflags);
+   // If direct is true (only 32-bit modes), the screen has no pixels of its own. Locking it
+   // locks the streaming texture and everything is drawn straight into it in the texture's
+   // format, so presenting does no copies. The texture memory is write-only: nothing drawn
+   // in the previous frame can be read back, so every pixel has to be redrawn every frame.
+   // pages is how many framebuffers the screen flips between (1 to VID_MAXPAGES). With more
+   // than one, a frame can be drawn into the draw page while the last one is presented.
+   static vidDriver *setVideoMode(unsigned int w, unsigned int h, int bits, int sdlflags, bool direct = false, int pages = 1);
    // Resizes the video. If the resize failed, a gFatalError is thrown. Returns a pointer
    // to the screen surface.
    //static vidDriver *resizeScreen(unsigned int w, unsigned int h);
-   // Calls SDL_Flip with the current screen surface.
+   // Swaps the screen pages and presents the page that was just drawn.
    static void flipVideoPage(void);
+   // Unlocks the draw page and makes it the front page. The next page becomes the draw page.
+   static void swapVideoPages(void);
+   // Presents the front page, if anything has been drawn yet. This only reads the front
+   // page, so the draw page can be drawn into (by another thread) at the same time.
+   static void presentVideoPage(void);
    // Updates a portion of the screen surface.
    //static void updateRect(vidRect &r);
    // Updates the window title
@@ -184,11 +208,15 @@ class vidDriver
 
    protected:
    // Protected helper functions -----------------------------------------------------------
+   // Creates the window, renderer and texture the surface is presented through.
+   void openWindow(bool direct, int pages);
    void noLongerScreen();
    void drawHLine(int x1, int x2, int y, Uint32 color);
    void drawVLine(int x, int y1, int y2, Uint32 color);
    void drawPositiveLine(int x1, int y1, int x2, int y2, Uint32 color);
    void drawNegativeLine(int x1, int y1, int x2, int y2, Uint32 color);
+   // True if the two surfaces have the same pixel layout.
+   bool sameFormat(vidDriver &dest);
 
    void setSurface(SDL_Surface &surface, bool owner);
 
@@ -199,7 +227,15 @@ class vidDriver
    SDL_Surface  *s;
    SDL_Surface  *rgba_surface;
    SDL_Rect     destrect;
-   bool         freesurface, mustlock, abnormalpitch, isscreen;
+   // Screen pages. With a direct screen every page is a texture and texture is the one being
+   // drawn into. Otherwise every page is a surface, s is the draw page and texture is only
+   // used to upload the front page.
+   SDL_Texture  *pagetextures[VID_MAXPAGES];
+   SDL_Surface  *pagesurfaces[VID_MAXPAGES];
+   // The drawn area of the draw page, and of every page when it was swapped to the front.
+   SDL_Rect     viewrect, pagerects[VID_MAXPAGES];
+   int          numpages, drawpage, frontpage;
+   bool         freesurface, mustlock, abnormalpitch, isscreen, directpresent;
    Uint8        *buffer, bitdepth;
    int          locks, pitch;
    int          width, height;
@@ -21,74 +21,246 @@
 #include <SDL.h>
 #include <math.h>
 #include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include "error.h"
 #include "mapdata.h"
 #include "visplane.h"
 #include "video.h"
 #include "render.h"
 #include "vectors.h"
+#include "jobs.h"
+#include "trace.h"
 
 
 
 
 // -- Flats --
-// Could also use a bucket array, but this is good enough for now.
-const int maxVisplanes = 1024;
-visplane_t visplanes[maxVisplanes];
-int nextFreeVisplane = 0;
+// The planes and their columns live in blocks of memory that are reused every frame. A pool
+// starts out with one block and gets another whenever a frame runs out of room.
+#define PLANE_BLOCK_SIZE (256 * 1024)
 
+struct planeblock_t
+{
+   planeblock_t   *next;
+   size_t         size, used;
+   Uint8          *data;
+};
 
-void clearPlane(visplane_t *plane)
+// Every plane is rasterized as its own job.
+struct planejob_t
 {
-   plane->x2 = -1;
-   plane->x1 = MAX_WIDTH;
+   const rendercontext_t   *ctx;
+   visplane_t              *plane;
 
-   plane->child = NULL;
-}
+   renderstats_t           stats;
+};
+
+
+static planeblock_t *newPlaneBlock(size_t size)
+{
+   planeblock_t *block = (planeblock_t *)malloc(sizeof(planeblock_t));
+   
+   if(!block || !(block->data = (Uint8 *)malloc(size)))
+      fatalError::Throw("newPlaneBlock: out of memory allocating visplanes");
 
+   block->next = NULL;
+   block->size = size;
+   block->used = 0;
+
+   return block;
+}
 
 
-void unlinkPlanes()
+// Returns 16 byte aligned memory that stays valid until the next unlinkPlanes.
+static void *allocPlaneMemory(planepool_t &pool, size_t size)
 {
-   nextFreeVisplane = 0;
+   planeblock_t *block = pool.curblock;
+   void *ret;
+
+   size = (size + 15) & ~(size_t)15;
+
+   while(block->used + size > block->size)
+   {
+      // Blocks left over from earlier frames are empty, use them first.
+      if(!block->next)
+         block->next = newPlaneBlock(size > PLANE_BLOCK_SIZE ? size : PLANE_BLOCK_SIZE);
+
+      block = pool.curblock = block->next;
+   }
+
+   ret = block->data + block->used;
+   block->used += size;
+
+   return ret;
 }
 
 
-visplane_t *findVisplane(float z, light_t light, pslope_t *slope)
+static visplane_t *newVisplane(planepool_t &pool)
 {
-   for(int i = 0; i < nextFreeVisplane; ++i)
+   visplane_t *plane;
+
+   if(pool.numvisplanes == pool.maxvisplanes)
    {
-      auto rover = visplanes + i;
+      int newmax = pool.maxvisplanes ? pool.maxvisplanes * 2 : 128;
+      visplane_t **newplanes = (visplane_t **)realloc(pool.visplanes, sizeof(visplane_t *) * newmax);
+      planejob_t *newjobs = (planejob_t *)realloc(pool.jobs, sizeof(planejob_t) * newmax);
+
+      if(newplanes)
+         pool.visplanes = newplanes;
+      if(newjobs)
+         pool.jobs = newjobs;
+      if(!newplanes || !newjobs)
+         fatalError::Throw("newVisplane: out of memory allocating visplanes");
+
+      pool.maxvisplanes = newmax;
+   }
 
-      if(fabs(rover->z - z) < 0.00001f && !memcmp(&light, &rover->light, sizeof(light_t)) && rover->slope == slope)
-         return rover;
+   plane = (visplane_t *)allocPlaneMemory(pool, sizeof(visplane_t));
+   pool.visplanes[pool.numvisplanes++] = plane;
+
+   plane->x2 = -1;
+   plane->x1 = INT_MAX;
+
+   plane->minx = 0;
+   plane->maxx = -1;
+   plane->top = plane->bot = NULL;
+
+   plane->child = NULL;
+   plane->next = NULL;
+
+   return plane;
+}
+
+
+// Makes sure the plane has room for the columns x1 through x2. When the arrays have to
+// grow they get some room to spare, walls tend to extend a plane a little at a time.
+static void reservePlaneColumns(planepool_t &pool, visplane_t *plane, int x1, int x2)
+{
+   int minx, maxx, count;
+   Uint16 *top, *bot;
+
+   if(x1 >= plane->minx && x2 <= plane->maxx)
+      return;
+
+   minx = x1;
+   maxx = x2;
+
+   if(plane->minx <= plane->maxx)
+   {
+      int slack = plane->maxx - plane->minx + 1;
+
+      if(minx < plane->minx)
+         minx -= slack;
+      else
+         minx = plane->minx;
+
+      if(maxx > plane->maxx)
+         maxx += slack;
+      else
+         maxx = plane->maxx;
+
+      if(minx < pool.x1)
+         minx = pool.x1;
+      if(maxx > pool.x2)
+         maxx = pool.x2;
    }
 
-   if (nextFreeVisplane == maxVisplanes)
+   // One extra column on each side for the sentinels.
+   count = maxx - minx + 3;
+   top = (Uint16 *)allocPlaneMemory(pool, sizeof(Uint16) * count * 2) + 1 - minx;
+   bot = top + count;
+
+   // Only the columns the plane covers so far have anything worth keeping.
+   if(plane->x1 <= plane->x2)
    {
-      fatalError::Throw("Ran out of free visplanes");
+      memcpy(top + plane->x1, plane->top + plane->x1, sizeof(Uint16) * (plane->x2 - plane->x1 + 1));
+      memcpy(bot + plane->x1, plane->bot + plane->x1, sizeof(Uint16) * (plane->x2 - plane->x1 + 1));
    }
 
-   visplane_t *result = visplanes + nextFreeVisplane;
-   nextFreeVisplane++;
+   plane->minx = minx;
+   plane->maxx = maxx;
+   plane->top = top;
+   plane->bot = bot;
+}
+
+
+
+void unlinkPlanes(planepool_t &pool, int x1, int x2)
+{
+   if(!pool.blocks)
+      pool.blocks = newPlaneBlock(PLANE_BLOCK_SIZE);
+
+   for(planeblock_t *block = pool.blocks; block; block = block->next)
+      block->used = 0;
+
+   pool.curblock = pool.blocks;
+   pool.numvisplanes = 0;
+   pool.numchildren = 0;
+   pool.x1 = x1;
+   pool.x2 = x2;
+
+   for(int i = 0; i < VISPLANE_HASH_SIZE; i++)
+      pool.hash[i] = NULL;
+}
+
+
+// Planes only match when their heights are exactly the same, so the hash can use the bits of
+// the height.
+static unsigned int visplaneHash(float z, Uint32 lightid, pslope_t *slope)
+{
+   Uint32 zbits;
+   unsigned int hash;
+
+   // -0 and 0 are the same height.
+   if(z == 0.0f)
+      z = 0.0f;
+
+   memcpy(&zbits, &z, sizeof(zbits));
+
+   hash = zbits * 2654435761u;
+   hash ^= lightid * 40503u;
+   hash ^= (unsigned int)((uintptr_t)slope >> 4);
+   hash ^= hash >> 16;
+
+   return hash & (VISPLANE_HASH_SIZE - 1);
+}
+
+
+visplane_t *findVisplane(planepool_t &pool, float z, Uint32 lightid, const light_t &light, pslope_t *slope)
+{
+   visplane_t **chain = pool.hash + visplaneHash(z, lightid, slope);
+
+   for(visplane_t *rover = *chain; rover; rover = rover->next)
+   {
+      if(rover->z == z && rover->lightid == lightid && rover->slope == slope)
+         return rover;
+   }
 
-   clearPlane(result);
+   visplane_t *result = newVisplane(pool);
 
    memcpy(&result->light, &light, sizeof(light_t));
+   result->lightid = lightid;
    result->z = z;
    result->slope = slope;
 
+   result->next = *chain;
+   *chain = result;
+
    return result;
 }
 
 
-visplane_t *checkVisplane(visplane_t *check, int x1, int x2)
+visplane_t *checkVisplane(planepool_t &pool, visplane_t *check, int x1, int x2)
 {
    visplane_t *ret;
    int openleft, openright;
 
    if(check->x1 > check->x2)
    {
+      reservePlaneColumns(pool, check, x1, x2);
+
       check->x1 = openleft = x1;
       check->x2 = openright = x2;
 
@@ -96,6 +268,8 @@ visplane_t *checkVisplane(visplane_t *check, int x1, int x2)
    }
    else if(x1 > check->x2)
    {
+      reservePlaneColumns(pool, check, check->x1, x2);
+
       openleft = check->x2 + 1;
       openright = x2;
 
@@ -104,6 +278,8 @@ visplane_t *checkVisplane(visplane_t *check, int x1, int x2)
    }
    else if(x2 < check->x1)
    {
+      reservePlaneColumns(pool, check, x1, check->x2);
+
       openleft = x1;
       openright = check->x1 - 1;
 
@@ -114,44 +290,108 @@ visplane_t *checkVisplane(visplane_t *check, int x1, int x2)
    {
       // No such luck, so check/create a child
       if(check->child)
-         return checkVisplane(check->child, x1, x2);
+         return checkVisplane(pool, check->child, x1, x2);
 
-      if (nextFreeVisplane == maxVisplanes)
-      {
-         fatalError::Throw("Ran out of visplanes");
-      }
-
-      visplane_t *child = visplanes + nextFreeVisplane;
-      nextFreeVisplane++;
-
-      clearPlane(child);
+      visplane_t *child = newVisplane(pool);
+      pool.numchildren++;
 
       memcpy(&child->light, &check->light, sizeof(light_t));
+      child->lightid = check->lightid;
       child->z = check->z;
       child->slope = check->slope;
-      child->child = check->child;
       check->child = child;
-      
+
+      reservePlaneColumns(pool, child, x1, x2);
+
       child->x1 = openleft = x1;
       child->x2 = openright = x2; 
    
       ret = child;
    }
 
+   // bot has to be cleared too, VISPLANE_NOTOP fits in a Uint16 so it no longer beats every
+   // possible value of bot.
    for(;openleft <= openright; openleft++)
-      ret->top[openleft] = INT_MAX;
+   {
+      ret->top[openleft] = VISPLANE_NOTOP;
+      ret->bot[openleft] = 0;
+   }
 
    return ret;
 }
 
-sv_t sv;
+// -- Flat row cache --
+// Like doom's cachedheight. What renderSpan works out for a row only depends on the row,
+// the plane's height and its light, so it is kept until a span of another plane in the same
+// row needs something else. Every thread that renders planes has its own.
+struct rowcache_t
+{
+   // The frame (see rendercontext_t::planeframe), height and light this row was set up for.
+   Uint32         frame, lightid;
+   float          height;
+
+   float          xorigin, yorigin;
+   float          xstep, ystep;
+   lightblend_t   blend;
+};
+
+static rowcache_t *getRowCache(int height)
+{
+   static thread_local rowcache_t *rowcache = NULL;
+   static thread_local int rowheight = 0;
+   static thread_local void *block = NULL;
+
+   if(height > rowheight)
+   {
+      // No frame is 0, so every row starts out empty.
+      rowcache = (rowcache_t *)allocCacheAligned(block, sizeof(rowcache_t) * height);
+      memset(rowcache, 0, sizeof(rowcache_t) * height);
+      rowheight = height;
+   }
+
+   return rowcache;
+}
+
+
+// Everything needed while one visplane is rasterized. Each plane job has its own on the
+// stack.
+struct planerender_t
+{
+   const camera_t    &camera;
+   const viewport_t  &view;
+   vidDriver         *target;
+
+   visplane_t        *plane;
+
+   // The light of a sloped plane, in colormaps.
+   float             shade;
+   int               *spanstart;
+
+   // For flat planes.
+   const float       *rowidy;
+   rowcache_t        *rowcache;
+   Uint32            frame;
+
+   // For sloped planes.
+   const sv_t        *slopevectors;
+
+   renderstats_t     &stats;
+
+   planerender_t(const rendercontext_t &ctx, visplane_t *p, renderstats_t &s)
+      : camera(ctx.camera), view(ctx.view), target(ctx.target), plane(p),
+        rowidy(ctx.rowidy), rowcache(NULL), frame(ctx.planeframe),
+        slopevectors(ctx.slopevectors), stats(s)
+   {
+   }
+};
 
-#define DOOMFLATORI
 #define NUMCOLORMAPS 256
 
-void renderSlopedSpan(int x1, int x2, int y, visplane_t *plane)
+void renderSlopedSpan(planerender_t &pr, int x1, int x2, int y)
 {
-   pslope_t *pslope = plane->slope;
+   const viewport_t &view = pr.view;
+   visplane_t *plane = pr.plane;
+   const sv_t &sv = pr.slopevectors[plane->slope->id];
    int   rdelta, gdelta, bdelta;
    int   count = x2 - x1;
    float map;
@@ -171,7 +411,8 @@ void renderSlopedSpan(int x1, int x2, int y, visplane_t *plane)
    slopespan.idstep = sv.c.x;
 
    slopespan.src = texture->getBuffer();
-   slopespan.dest = screen->getBuffer();
+   slopespan.dest = pr.target->getBuffer();
+   slopespan.pitch = view.pitch;
 
    slopespan.x1 = x1;
    slopespan.x2 = x2;
@@ -179,7 +420,7 @@ void renderSlopedSpan(int x1, int x2, int y, visplane_t *plane)
 
    // Setup lighting
    base = 4*(plane->light.l_level) - 448;
-   map = base - (NUMCOLORMAPS - (sv.shade - sv.plight * slopespan.idfrac));
+   map = base - (NUMCOLORMAPS - (pr.shade - sv.plight * slopespan.idfrac));
 
    slopelightblend_t blend = calcSlopeLight(0.0f, map, plane->light);
    slopespan.rfrac = (int)(blend.rf * 65536.0f);
@@ -190,7 +431,7 @@ void renderSlopedSpan(int x1, int x2, int y, visplane_t *plane)
    {
       float id = slopespan.idfrac + slopespan.idstep * (x2 - x1);
 
-      map = base - (NUMCOLORMAPS - (sv.shade - sv.plight * id));
+      map = base - (NUMCOLORMAPS - (pr.shade - sv.plight * id));
 
       blend = calcSlopeLight(0.0f, map, plane->light);
       rdelta = (int)(blend.rf * 65536.0f) - slopespan.rfrac;
@@ -204,74 +445,90 @@ void renderSlopedSpan(int x1, int x2, int y, visplane_t *plane)
    else
       slopespan.rstep = slopespan.gstep = slopespan.bstep = 0;
 
-   drawSlopedSpan(slopespan);
+   view.slopespanfunc(slopespan);
+
+   pr.stats.counters[STAT_SPANS]++;
+   pr.stats.counters[STAT_PIXELS] += x2 - x1 + 1;
 }
 
 
 
 
 
-void renderSpan(int x1, int x2, int y, visplane_t *plane)
+void renderSpan(planerender_t &pr, int x1, int x2, int y)
 {
-   float iscale, dy, xstep, ystep, realy, height;
+   const camera_t &camera = pr.camera;
+   const viewport_t &view = pr.view;
+   visplane_t *plane = pr.plane;
+   rowcache_t &row = pr.rowcache[y];
+   float height;
    renderspan_t span;
 
    // offset the height based on the camera
    height = plane->z - camera.z;
    if(!height) return; // avoid divide by 0
 
-   // if you recall from the equations with wall height to screen y projection
-   //                       (height - camz) * yfoc
-   //  screeny = ycenter - ------------------------
-   //                               y
-
-   // solving this equation for y you get
-   //      (height - camz) * yfoc
-   // y = ----------------------------
-   //         ycenter - screeny
-
-   // .01 is added to make sure that when screeny == ycenter there is no divide by 0
-   if(view.ycenter == y)
-      dy = 0.01f;
-   else if(y < view.ycenter)
-      dy = fabsf(view.ycenter - y) - 1.0f;
-   else
-      dy = fabsf(view.ycenter - y) + 1.0f;
+   // Every span of the row at this height and light has the same distance, steps and light.
+   if(row.frame != pr.frame || row.height != height || row.lightid != plane->lightid)
+   {
+      float iscale, xstep, ystep, realy;
+
+      // if you recall from the equations with wall height to screen y projection
+      //                       (height - camz) * yfoc
+      //  screeny = ycenter - ------------------------
+      //                               y
+
+      // solving this equation for y you get
+      //      (height - camz) * yfoc
+      // y = ----------------------------
+      //         ycenter - screeny
+
+      // rowidy holds 1 / (ycenter - screeny) for every row.
+      iscale = fabsf(height) * pr.rowidy[y];
+      realy = iscale * view.yfoc;
 
-   iscale = fabsf(height/dy);
-   realy = iscale * view.yfoc;
+      iscale *= view.focratio;
 
-   iscale *= view.focratio;
+      // steps are calculated using trig and the slope ratio
+      xstep = view.cos * iscale;
+      ystep = -view.sin * iscale;
 
-   // steps are calculated using trig and the slope ratio
-   xstep = view.cos * iscale;
-   ystep = -view.sin * iscale;
+      row.frame = pr.frame;
+      row.height = height;
+      row.lightid = plane->lightid;
 
-   span.blend = calcLight(1.0f / realy, 0, plane->light);
+      row.blend = getLightBlend(plane->lightid, 1.0f / realy);
+
+      // the texture coordinates are first calculated at the center of the screen and
+      // then offsetted using the step values to x1.
+      row.xorigin = camera.x + (view.sin * realy);
+      row.yorigin = camera.y + (view.cos * realy);
+      row.xstep = xstep;
+      row.ystep = ystep;
+   }
 
-   // the texture coordinates are first calculated at the center of the screen and
-   // then offsetted using the step values to x1.
    // these values are then converted to 16.16 fixed point for a major speed increase
-   span.xfrac = (int)((camera.x + (view.sin * realy) + ((x1 - view.xcenter) * xstep)) * 65536.0f);
-   span.yfrac = (int)((camera.y + (view.cos * realy) + ((x1 - view.xcenter) * ystep)) * 65536.0f);
-   span.xstep = (int)(xstep * 65536.0f);
-   span.ystep = (int)(ystep * 65536.0f);
+   span.blend = row.blend;
+   span.xfrac = (int)((row.xorigin + ((x1 - view.xcenter) * row.xstep)) * 65536.0f);
+   span.yfrac = (int)((row.yorigin + ((x1 - view.xcenter) * row.ystep)) * 65536.0f);
+   span.xstep = (int)(row.xstep * 65536.0f);
+   span.ystep = (int)(row.ystep * 65536.0f);
    span.x1 = x1;
    span.x2 = x2;
    span.y = y;
    span.tex = texture->getBuffer();
-   span.screen = screen->getBuffer();
-
-   drawSpan(span);
-}
+   span.screen = pr.target->getBuffer();
+   span.pitch = view.pitch;
 
+   view.spanfunc(span);
 
-
-int spanstart[MAX_HEIGHT];
+   pr.stats.counters[STAT_SPANS]++;
+   pr.stats.counters[STAT_PIXELS] += x2 - x1 + 1;
+}
 
 
 
-void translateVector3f(vector3f &v)
+static void translateVector3f(const camera_t &camera, const viewport_t &view, vector3f &v)
 {
    float tx, ty, tz;
 
@@ -286,59 +543,24 @@ void translateVector3f(vector3f &v)
 }
 
 
-void calcSlopeVectors(visplane_t *plane)
+static void calcSlopeVectors(const camera_t &camera, const viewport_t &view, pslope_t *slope, sv_t &sv)
 {
-   int x, y;
+   vector3f p = slope->texp, m = slope->texm, n = slope->texn;
    float ixscale, iyscale;
 
-   x = (int)plane->slope->xori;
-   y = (int)plane->slope->yori;
-
-   // TODO: replace 64 with actual texture width.
-   x -= x % 64;
-   y -= y % 64;
-
-   // Also todo: the slope texture vectors should really be stored in the
-   // slope struct and precalculated once per frame.
-   sv.p.x = (float)x;
-   sv.p.z = (float)(y - 64);
-   sv.p.y = zPositionAt(plane->slope, sv.p.x, sv.p.z);
-
-#ifdef DOOMFLATORI
-   // Should be texture width.. Also, todo: Rotation
-   sv.m.x = sv.p.x - 64.0f;
-   sv.m.z = sv.p.z;
-   sv.m.y = zPositionAt(plane->slope, sv.m.x, sv.m.z);
-
-   // Should be texture width.. Also, todo: Rotation
-   sv.n.x = sv.p.x;
-   sv.n.z = sv.p.z - 64.0f;
-   sv.n.y = zPositionAt(plane->slope, sv.n.x, sv.n.z);
-#else
-   // Should be texture width.. Also, todo: Rotation
-   sv.m.x = sv.p.x;
-   sv.m.z = sv.p.z + 64.0f;
-   sv.m.y = zPositionAt(plane->slope, sv.m.x, sv.m.z);
-
-   // Should be texture width.. Also, todo: Rotation
-   sv.n.x = sv.p.x + 64.0f;
-   sv.n.z = sv.p.z;
-   sv.n.y = zPositionAt(plane->slope, sv.n.x, sv.n.z);
-#endif
-
    // SoM:
    // **WRONG** Project the vectors. **WRONG**
    // Translate the vectors.
-   translateVector3f(sv.p);
-   translateVector3f(sv.m);
-   translateVector3f(sv.n);
+   translateVector3f(camera, view, p);
+   translateVector3f(camera, view, m);
+   translateVector3f(camera, view, n);
 
-   sv.m = sv.m - sv.p;
-   sv.n = sv.n - sv.p;
+   m = m - p;
+   n = n - p;
 
-   sv.a = vector3f::getCross(sv.p, sv.n);
-   sv.b = vector3f::getCross(sv.p, sv.m);
-   sv.c = vector3f::getCross(sv.m, sv.n);
+   sv.a = vector3f::getCross(p, n);
+   sv.b = vector3f::getCross(p, m);
+   sv.c = vector3f::getCross(m, n);
 
    // This is helpful for removing some of the muls when calculating light.
    sv.a.x *= 0.5f;
@@ -353,39 +575,80 @@ void calcSlopeVectors(visplane_t *plane)
    sv.c.y *= 0.5f / view.focratio;
    sv.c.z *= 0.5f;
 
-   sv.zat = zPositionAt(plane->slope, camera.x, camera.y);
+   sv.zat = zPositionAt(slope, camera.x, camera.y);
 
    // More help from randy. I was totally lost on this... 
    ixscale = 1.0f / 64.0f;
    iyscale = 1.0f / 64.0f;
 
-   sv.plight = (sv.vis * ixscale * iyscale) / (sv.zat - camera.z);
-   sv.shade = NUMCOLORMAPS * 2.0f - (plane->light.l_level + 16.0f) * NUMCOLORMAPS / 128.0f;
+   sv.plight = (view.slopevis * ixscale * iyscale) / (sv.zat - camera.z);
+}
+
+
+void setupSlopes(rendercontext_t &ctx)
+{
+   for(Uint32 i = 0; i < sectorcount; i++)
+   {
+      pslope_t *fslope = sectorlist[i].fslope, *cslope = sectorlist[i].cslope;
+
+      if(fslope)
+         calcSlopeVectors(ctx.camera, ctx.view, fslope, ctx.slopevectors[fslope->id]);
+      if(cslope)
+         calcSlopeVectors(ctx.camera, ctx.view, cslope, ctx.slopevectors[cslope->id]);
+   }
 }
 
 
-void renderVisplane(visplane_t *plane)
+// Every thread that renders planes has its own spanstart array, as tall as the tallest
+// view it has rendered.
+static int *getSpanStart(int height)
 {
+   static thread_local int *spanstart = NULL, spanheight = 0;
+   static thread_local void *block = NULL;
+
+   if(height > spanheight)
+   {
+      spanstart = (int *)allocCacheAligned(block, sizeof(int) * height);
+      spanheight = height;
+   }
+
+   return spanstart;
+}
+
+
+void renderVisplane(const rendercontext_t &ctx, visplane_t *plane, renderstats_t &stats)
+{
+   scopedphase_t phase(stats, PHASE_PLANES);
+   scopedtrace_t trace("renderVisplane");
+   planerender_t pr(ctx, plane, stats);
+   int *spanstart = pr.spanstart = getSpanStart(ctx.view.height);
    int x, stop, t1, t2, b1, b2;
-   void (*rspanfunc)(int, int, int, visplane_t*) = renderSpan;
+   void (*rspanfunc)(planerender_t &, int, int, int) = renderSpan;
+
+   if(plane->x1 > plane->x2)
+      return;
 
    if(plane->slope)
    {
-      calcSlopeVectors(plane);
+      float zat = ctx.slopevectors[plane->slope->id].zat;
 
-      if(plane->slope->isceiling == true && sv.zat <= camera.z)
+      if(plane->slope->isceiling == true && zat <= ctx.camera.z)
          return;
 
-      if(plane->slope->isceiling == false && sv.zat >= camera.z)
+      if(plane->slope->isceiling == false && zat >= ctx.camera.z)
          return;
 
+      pr.shade = NUMCOLORMAPS * 2.0f - (plane->light.l_level + 16.0f) * NUMCOLORMAPS / 128.0f;
+
       rspanfunc = renderSlopedSpan;
    }
+   else
+      pr.rowcache = getRowCache(ctx.view.height);
 
    x = plane->x1;
    stop = plane->x2 + 1;
 
-   plane->top[x - 1] = plane->top[stop] = INT_MAX;
+   plane->top[x - 1] = plane->top[stop] = VISPLANE_NOTOP;
    plane->bot[x - 1] = plane->bot[stop] = 0;
 
    for(;x <= stop; x++)
@@ -396,28 +659,42 @@ void renderVisplane(visplane_t *plane)
       b2 = plane->bot[x];
 
       for(; t2 > t1 && t1 <= b1; t1++)
-         rspanfunc(spanstart[t1], x - 1, t1, plane);
+         rspanfunc(pr, spanstart[t1], x - 1, t1);
       for(; b2 < b1 && t1 <= b1; b1--)
-         rspanfunc(spanstart[b1], x - 1, b1, plane);
+         rspanfunc(pr, spanstart[b1], x - 1, b1);
 
       while(t2 < t1 && t2 <= b2)
          spanstart[t2++] = x;
       while(b2 > b1 && t2 <= b2)
          spanstart[b2--] = x;
    }
+}
 
-   if(plane->child)
-      renderVisplane(plane->child);
+
+static void renderVisplaneJob(void *data)
+{
+   planejob_t *job = (planejob_t *)data;
+
+   renderVisplane(*job->ctx, job->plane, job->stats);
 }
 
 
-void renderVisplanes()
+// No two visplanes ever cover the same pixel, so every plane is rasterized as its own job.
+// Child planes are in the pool too and get their own jobs.
+void renderVisplanes(const rendercontext_t &ctx, planepool_t &pool, renderstats_t &stats)
 {
-   visplane_t *rover;
+   jobgroup_t group;
 
-   for (int i = 0; i < nextFreeVisplane; ++i)
+   for (int i = 0; i < pool.numvisplanes; ++i)
    {
-      rover = visplanes + i;
-      renderVisplane(rover);
+      pool.jobs[i].ctx = &ctx;
+      pool.jobs[i].plane = pool.visplanes[i];
+      clearStats(pool.jobs[i].stats);
+      forkJob(group, renderVisplaneJob, pool.jobs + i);
    }
+
+   joinJobs(group);
+
+   for (int i = 0; i < pool.numvisplanes; ++i)
+      addStats(stats, pool.jobs[i].stats);
 }
@@ -26,35 +26,69 @@ struct visplane_t
 {
 	visplane_t *child;
 
+   // The next plane in the same hash chain.
+   visplane_t *next;
+
    float z;
    light_t light;
+   Uint32 lightid;
 
    pslope_t *slope;
 
    int x1, x2;
-   int pad1, top[MAX_WIDTH], pad2, pad3, bot[MAX_WIDTH], pad4;
+
+   // The columns the top and bot arrays have room for. top and bot can also be indexed one
+   // column to either side of that, renderVisplane writes sentinels there.
+   int minx, maxx;
+   Uint16 *top, *bot;
 };
 
-struct sv_t
+// top is set to this for columns the plane doesn't cover.
+#define VISPLANE_NOTOP 0xffff
+
+struct planejob_t;
+struct planeblock_t;
+
+// Must be a power of 2.
+#define VISPLANE_HASH_SIZE 256
+
+// -- Visplane pools --
+// Every strip of a render context has its own pool of visplanes so strips can be rendered
+// at the same time.
+struct planepool_t
 {
-   // Magic vectors!
-   vector3f  m, n, p;
-   vector3f  a, b, c;
+   // Every plane found or created this frame, in the order they were made.
+   visplane_t  **visplanes;
+   int         numvisplanes, maxvisplanes;
+
+   // How many of them are children.
+   int         numchildren;
+
+   // The visplanes and their column arrays are carved out of these blocks. The blocks are
+   // kept from frame to frame and more are added when a frame needs more room.
+   planeblock_t *blocks, *curblock;
+
+   // The columns the planes can cover.
+   int         x1, x2;
 
-   float sinslope;
-   float zat;
+   // findVisplane looks planes up by height, light and slope. Only the first plane of each
+   // height/light/slope is hashed, the rest hang off of it as children.
+   visplane_t  *hash[VISPLANE_HASH_SIZE];
 
-   float pscale;
-   float vis;
-   float plight;
-   float shade;
+   planejob_t  *jobs;
 };
 
-extern sv_t sv;
+visplane_t *findVisplane(planepool_t &pool, float z, Uint32 lightid, const light_t &light, pslope_t *slope);
+visplane_t *checkVisplane(planepool_t &pool, visplane_t *check, int x1, int x2);
 
-visplane_t *findVisplane(float z, light_t light, pslope_t *slope);
-visplane_t *checkVisplane(visplane_t *check, int x1, int x2);
+// Sets up the context's texture vectors of every slope in the map for its camera. Must be
+// called before the frame's planes are rendered.
+void setupSlopes(rendercontext_t &ctx);
 
-void renderVisplanes();
+// Rasterizes one plane into the context's target. The spans drawn and their time are added
+// to stats.
+void renderVisplane(const rendercontext_t &ctx, visplane_t *plane, renderstats_t &stats);
+void renderVisplanes(const rendercontext_t &ctx, planepool_t &pool, renderstats_t &stats);
 
-void unlinkPlanes();
+// Starts a new frame of planes covering the columns x1 through x2.
+void unlinkPlanes(planepool_t &pool, int x1, int x2);